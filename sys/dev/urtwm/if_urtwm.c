@@ -39,11 +39,17 @@ __FBSDID("$FreeBSD$");
 #include <sys/malloc.h>
 #include <sys/module.h>
 #include <sys/bus.h>
+#include <sys/cpuset.h>
+#include <sys/smp.h>
+#include <sys/priority.h>
+#include <sys/taskqueue.h>
 #include <sys/endian.h>
 #include <sys/linker.h>
 #include <sys/firmware.h>
+#include <sys/sbuf.h>
 #include <sys/kdb.h>
 
+#include <machine/atomic.h>
 #include <machine/bus.h>
 #include <machine/resource.h>
 #include <sys/rman.h>
@@ -98,6 +104,7 @@ enum {
 	URTWM_DEBUG_RSSI	= 0x00001000,	/* dump RSSI lookups */
 	URTWM_DEBUG_RESET	= 0x00002000,	/* initialization progress */
 	URTWM_DEBUG_CALIB	= 0x00004000,	/* calibration progress */
+	URTWM_DEBUG_DIG		= 0x00008000,	/* dynamic initial gain */
 	URTWM_DEBUG_ANY		= 0xffffffff
 };
 
@@ -149,6 +156,19 @@ static usb_callback_t	urtwm_bulk_rx_callback;
 
 static void		urtwm_radiotap_attach(struct urtwm_softc *);
 static void		urtwm_sysctlattach(struct urtwm_softc *);
+static int		urtwm_sysctl_ratectl(SYSCTL_HANDLER_ARGS);
+static int		urtwm_sysctl_xfer(SYSCTL_HANDLER_ARGS);
+#ifdef USB_DEBUG
+static int		urtwm_sysctl_chansw_bench(SYSCTL_HANDLER_ARGS);
+static int		urtwm_sysctl_chansw_bench_res(SYSCTL_HANDLER_ARGS);
+static int		urtwm_sysctl_rssi_bench(SYSCTL_HANDLER_ARGS);
+#endif
+static int		urtwm_sysctl_survey(SYSCTL_HANDLER_ARGS);
+static int		urtwm_sysctl_survey_clear(SYSCTL_HANDLER_ARGS);
+static int		urtwm_sysctl_rxagg(SYSCTL_HANDLER_ARGS);
+static int		urtwm_sysctl_mon_profile(SYSCTL_HANDLER_ARGS);
+static int		urtwm_sysctl_mon_filter(SYSCTL_HANDLER_ARGS);
+static int		urtwm_sysctl_mon_bssid(SYSCTL_HANDLER_ARGS);
 static void		urtwm_drain_mbufq(struct urtwm_softc *);
 static usb_error_t	urtwm_do_request(struct urtwm_softc *,
 			    struct usb_device_request *, void *);
@@ -175,9 +195,29 @@ static struct mbuf *	urtwm_report_intr(struct urtwm_softc *,
 static void		urtwm_c2h_report(struct urtwm_softc *, uint8_t *, int);
 static void		urtwm_ratectl_tx_complete(struct urtwm_softc *,
 			    void *, int);
-static struct mbuf *	urtwm_rxeof(struct urtwm_softc *, uint8_t *, int);
+static struct mbuf *	urtwm_rx_carry(struct urtwm_softc *, uint8_t **,
+			    int *, int);
+static void		urtwm_rx_carry_drop(struct urtwm_softc *);
+static struct mbuf *	urtwm_rxeof(struct urtwm_softc *, uint8_t *, int,
+			    int);
+static struct ieee80211_node *urtwm_rx_find_node(struct urtwm_softc *,
+			    struct ieee80211_frame_min *, uint32_t);
+static void		urtwm_rx_params(struct urtwm_softc *, struct mbuf *,
+			    int8_t, struct r12a_rx_phystat *);
 static struct ieee80211_node *urtwm_rx_frame(struct urtwm_softc *,
 			    struct mbuf *, int8_t *);
+static void		urtwm_rx_deliver(struct urtwm_softc *,
+			    struct ieee80211_node *, struct mbuf *, int8_t);
+static void		urtwm_rx_input(struct urtwm_softc *, struct mbuf *);
+static void		urtwm_rx_enter(struct urtwm_softc *);
+static void		urtwm_rx_exit(struct urtwm_softc *);
+static void		urtwm_rx_block(struct urtwm_softc *);
+static void		urtwm_rx_unblock(struct urtwm_softc *);
+static void		urtwm_rxq_enqueue(struct urtwm_softc *,
+			    struct mbuf *);
+static void		urtwm_rxq_drain(struct urtwm_softc *);
+static void		urtwm_rxq_task(void *, int);
+static int		urtwm_rxtq_attach(struct urtwm_softc *);
 static void		urtwm_txeof(struct urtwm_softc *, struct urtwm_data *,
 			    int);
 static int		urtwm_alloc_list(struct urtwm_softc *,
@@ -216,10 +256,12 @@ static usb_error_t	urtwm_setbits_4(struct urtwm_softc *, uint16_t,
 static int		urtwm_fw_cmd(struct urtwm_softc *, uint8_t,
 			    const void *, int);
 #endif
+static int		urtwm_cmdq_coalesce_idx(CMD_FUNC_PROTO);
 static void		urtwm_cmdq_cb(void *, int);
+static void		urtwm_cmdq_drain(struct urtwm_softc *);
 static int		urtwm_cmd_sleepable(struct urtwm_softc *, const void *,
 			    size_t, CMD_FUNC_PROTO);
-static void		urtwm_rf_write(struct urtwm_softc *, int,
+static usb_error_t	urtwm_rf_write(struct urtwm_softc *, int,
 			    uint8_t, uint32_t);
 static uint32_t		urtwm_r12a_rf_read(struct urtwm_softc *, int, uint8_t);
 static uint32_t		urtwm_r21a_rf_read(struct urtwm_softc *, int, uint8_t);
@@ -238,6 +280,7 @@ static int		urtwm_efuse_read(struct urtwm_softc *, uint8_t *,
 			    uint16_t);
 static int		urtwm_efuse_switch_power(struct urtwm_softc *);
 static int		urtwm_setup_endpoints(struct urtwm_softc *);
+static int		urtwm_setup_xfers(struct urtwm_softc *);
 static int		urtwm_read_chipid(struct urtwm_softc *);
 static int		urtwm_r12a_check_condition(struct urtwm_softc *,
 			    const uint8_t[]);
@@ -252,6 +295,23 @@ static void		urtwm_r21a_parse_rom(struct urtwm_softc *,
 			    struct r12a_rom *);
 static void		urtwm_parse_rom(struct urtwm_softc *,
 			    struct r12a_rom *);
+static void		urtwm_ra_node_init_cb(struct urtwm_softc *,
+			    union sec_param *);
+static void		urtwm_ra_node_init(struct urtwm_softc *,
+			    struct ieee80211_node *);
+static uint8_t		urtwm_ra_rssi_rate(struct urtwm_ra_node *, int8_t);
+static void		urtwm_ra_update(struct urtwm_softc *,
+			    struct urtwm_ra_node *);
+static void		urtwm_ra_txq_remove(struct urtwm_ra_node *, int);
+static void		urtwm_ra_txq_expire(struct urtwm_ra_node *);
+static void		urtwm_ra_txq_push(struct urtwm_softc *,
+			    struct ieee80211_node *, uint8_t, uint8_t);
+static void		urtwm_ra_txq_reset(struct urtwm_softc *);
+static uint8_t		urtwm_ra_get_rate(struct urtwm_softc *,
+			    struct ieee80211_node *, uint8_t *);
+static void		urtwm_ra_tx_complete(struct urtwm_softc *,
+			    struct ieee80211_node *,
+			    const struct r12a_c2h_tx_rpt *);
 #ifdef URTWM_TODO
 static int		urtwm_ra_init(struct urtwm_softc *);
 #endif
@@ -285,15 +345,26 @@ static int		urtwm_set_pwrmode(struct urtwm_softc *,
 static void		urtwm_set_media_status(struct urtwm_softc *,
 			    union sec_param *);
 #endif
+static int		urtwm_gkey_offload(struct urtwm_softc *,
+			    struct ieee80211vap *,
+			    const struct ieee80211_key *);
+static struct ieee80211_node *urtwm_key_owner(struct urtwm_softc *, int);
+static int		urtwm_key_lru(struct urtwm_softc *,
+			    struct urtwm_node *);
+static void		urtwm_key_demote(struct urtwm_softc *, int);
 static int		urtwm_key_alloc(struct ieee80211vap *,
 			    struct ieee80211_key *, ieee80211_keyix *,
 			    ieee80211_keyix *);
+static void		urtwm_key_stage(struct urtwm_softc *,
+			    const struct ieee80211_key *);
 static void		urtwm_key_set_cb(struct urtwm_softc *,
 			    union sec_param *);
 static void		urtwm_key_del_cb(struct urtwm_softc *,
 			    union sec_param *);
 static int		urtwm_process_key(struct ieee80211vap *,
 			    const struct ieee80211_key *, int);
+static void		urtwm_key_promote_cb(struct urtwm_softc *,
+			    union sec_param *);
 static int		urtwm_key_set(struct ieee80211vap *,
 			    const struct ieee80211_key *);
 static int		urtwm_key_delete(struct ieee80211vap *,
@@ -318,12 +389,19 @@ static int		urtwm_monitor_newstate(struct ieee80211vap *,
 static int		urtwm_newstate(struct ieee80211vap *,
 			    enum ieee80211_state, int);
 static void		urtwm_calib_to(void *);
+static void		urtwm_calib_sched(struct urtwm_softc *);
+static void		urtwm_dig(struct urtwm_softc *);
+static void		urtwm_dig_reset(struct urtwm_softc *);
 static void		urtwm_calib_cb(struct urtwm_softc *,
 			    union sec_param *);
-static int8_t		urtwm_r12a_get_rssi_cck(struct urtwm_softc *, void *);
-static int8_t		urtwm_r21a_get_rssi_cck(struct urtwm_softc *, void *);
-static int8_t		urtwm_get_rssi_ofdm(struct urtwm_softc *, void *);
+static int8_t		urtwm_r12a_cck_pwdb(uint8_t, int);
+static int8_t		urtwm_r21a_cck_pwdb(uint8_t, int);
+static void		urtwm_rssi_init(struct urtwm_softc *);
 static int8_t		urtwm_get_rssi(struct urtwm_softc *, int, void *);
+#ifdef USB_DEBUG
+static int8_t		urtwm_get_rssi_ref(struct urtwm_softc *, int,
+			    struct r12a_rx_phystat *);
+#endif
 static void		urtwm_tx_protection(struct urtwm_softc *,
 			    struct r12a_tx_desc *, enum ieee80211_protmode);
 static void		urtwm_tx_raid(struct urtwm_softc *,
@@ -340,6 +418,7 @@ static int		urtwm_tx_raw(struct urtwm_softc *,
 			    const struct ieee80211_bpf_params *);
 static void		urtwm_tx_start(struct urtwm_softc *, struct mbuf *,
 			    uint8_t, struct urtwm_data *);
+static void		urtwm_tx_kick(struct urtwm_softc *, int);
 static void		urtwm_tx_checksum(struct r12a_tx_desc *);
 static int		urtwm_transmit(struct ieee80211com *, struct mbuf *);
 static void		urtwm_start(struct urtwm_softc *);
@@ -374,25 +453,52 @@ static void		urtwm_r12a_set_band_2ghz(struct urtwm_softc *);
 static void		urtwm_r21a_set_band_2ghz(struct urtwm_softc *);
 static void		urtwm_r12a_set_band_5ghz(struct urtwm_softc *);
 static void		urtwm_r21a_set_band_5ghz(struct urtwm_softc *);
+static int		urtwm_get_swing_idx(struct urtwm_softc *,
+			    struct ieee80211_channel *, int);
+static void		urtwm_write_tx_scale(struct urtwm_softc *,
+			    struct ieee80211_channel *, int);
+static int		urtwm_pwrtrk_split(struct urtwm_softc *,
+			    struct ieee80211_channel *);
 static void		urtwm_set_band(struct urtwm_softc *,
 			    struct ieee80211_channel *, int);
 static void		urtwm_cam_init(struct urtwm_softc *);
+static void		urtwm_seccfg_update(struct urtwm_softc *);
+static void		urtwm_gkey_demote(struct urtwm_softc *);
 static int		urtwm_cam_write(struct urtwm_softc *, uint32_t,
 			    uint32_t);
+static int		urtwm_cam_write_stream(struct urtwm_softc *,
+			    const uint16_t[], const uint32_t[], int);
+static void		urtwm_cam_stage(struct urtwm_softc *, int,
+			    const uint32_t[]);
+static void		urtwm_cam_flush(struct urtwm_softc *);
 static void		urtwm_rxfilter_update_mgt(struct urtwm_softc *);
 static void		urtwm_rxfilter_update(struct urtwm_softc *);
 static void		urtwm_rxfilter_init(struct urtwm_softc *);
+static void		urtwm_rxfilter_mon(struct urtwm_softc *);
 static void		urtwm_edca_init(struct urtwm_softc *);
 static void		urtwm_mrr_init(struct urtwm_softc *);
+static void		urtwm_write_txagc(struct urtwm_softc *, int, int,
+			    const uint32_t[], int);
 static void		urtwm_write_txpower(struct urtwm_softc *, int,
 			    struct ieee80211_channel *, uint16_t[]);
 static int		urtwm_get_power_group(struct urtwm_softc *,
 			    struct ieee80211_channel *);
-static void		urtwm_get_txpower(struct urtwm_softc *, int,
-		      	    struct ieee80211_channel *, uint16_t[]);
+static void		urtwm_get_txpower(struct urtwm_softc *, int, int,
+			    int, int, uint8_t[]);
+static void		urtwm_init_txpower(struct urtwm_softc *);
+static uint32_t		urtwm_txpower_rates(struct urtwm_softc *,
+			    struct ieee80211_channel *);
 static void		urtwm_set_txpower(struct urtwm_softc *,
 		    	    struct ieee80211_channel *);
 static void		urtwm_set_rx_bssid_all(struct urtwm_softc *, int);
+static int		urtwm_survey_idx(struct urtwm_softc *,
+			    struct ieee80211_channel *);
+static void		urtwm_survey_start(struct urtwm_softc *,
+			    struct ieee80211_channel *);
+static void		urtwm_survey_stop(struct urtwm_softc *);
+static void		urtwm_bgscan_leave(struct urtwm_softc *);
+static void		urtwm_bgscan_return(struct urtwm_softc *);
+static void		urtwm_bgscan_to(void *);
 static void		urtwm_scan_start(struct ieee80211com *);
 static void		urtwm_scan_curchan(struct ieee80211_scan_state *,
 			    unsigned long);
@@ -401,6 +507,16 @@ static void		urtwm_getradiocaps(struct ieee80211com *, int, int *,
 			    struct ieee80211_channel[]);
 static void		urtwm_update_chw(struct ieee80211com *);
 static void		urtwm_set_channel(struct ieee80211com *);
+static void		urtwm_edca_write(struct urtwm_softc *, int,
+			    const struct wmeParams *);
+static void		urtwm_edca_turbo_set(struct urtwm_softc *, int);
+static void		urtwm_edca_turbo(struct urtwm_softc *);
+static void		urtwm_edca_turbo_off_cb(struct urtwm_softc *,
+			    union sec_param *);
+static void		urtwm_rxagg_thresh(struct urtwm_softc *, int,
+			    int *, int *);
+static void		urtwm_rxagg_set(struct urtwm_softc *, int);
+static void		urtwm_rxagg_update(struct urtwm_softc *);
 static int		urtwm_wme_update(struct ieee80211com *);
 static void		urtwm_update_slot(struct ieee80211com *);
 static void		urtwm_update_slot_cb(struct urtwm_softc *,
@@ -420,10 +536,35 @@ static struct ieee80211_node *urtwm_node_alloc(struct ieee80211vap *,
 static void		urtwm_newassoc(struct ieee80211_node *, int);
 static void		urtwm_node_free(struct ieee80211_node *);
 static void		urtwm_fix_spur(struct urtwm_softc *,
+			    struct ieee80211_channel *, struct urtwm_chan_regs *);
+static void		urtwm_chan_regs_read(struct urtwm_softc *,
+			    struct urtwm_chan_regs *);
+static void		urtwm_chan_compile(struct urtwm_softc *,
+			    struct ieee80211_channel *, struct urtwm_chan_regs *);
+static int		urtwm_chan_replay(struct urtwm_softc *,
+			    const struct urtwm_chan_regs *);
+static int		urtwm_chan_program(struct urtwm_softc *,
 			    struct ieee80211_channel *);
 static void		urtwm_set_chan(struct urtwm_softc *,
 		    	    struct ieee80211_channel *);
 static void		urtwm_antsel_init(struct urtwm_softc *);
+static uint16_t		urtwm_iqk_key(struct urtwm_softc *,
+			    struct ieee80211_channel *);
+static void		urtwm_iqk_read(struct urtwm_softc *,
+			    struct urtwm_iqk_result *);
+static void		urtwm_iqk_write(struct urtwm_softc *,
+			    const struct urtwm_iqk_result *);
+static void		urtwm_iqk_store(struct urtwm_softc *,
+			    struct ieee80211_channel *,
+			    const struct urtwm_iqk_result *);
+static void		urtwm_iqk_restore(struct urtwm_softc *,
+			    struct ieee80211_channel *);
+static void		urtwm_iqk_save_cb(struct urtwm_softc *,
+			    union sec_param *);
+static int		urtwm_iqk_run(struct urtwm_softc *, int, int,
+			    uint16_t *, uint16_t *);
+static int		urtwm_iqk_chain(struct urtwm_softc *, int,
+			    struct urtwm_iqk_result *);
 static void		urtwm_iq_calib_sw(struct urtwm_softc *);
 #ifndef URTWM_WITHOUT_UCODE
 static int		urtwm_iq_calib_fw_supported(struct urtwm_softc *);
@@ -431,6 +572,8 @@ static void		urtwm_iq_calib_fw(struct urtwm_softc *);
 #endif
 static void		urtwm_iq_calib(struct urtwm_softc *);
 static void		urtwm_lc_calib(struct urtwm_softc *);
+static void		urtwm_calib_request(struct urtwm_softc *, uint8_t);
+static void		urtwm_pwrtrk(struct urtwm_softc *, uint8_t);
 static void		urtwm_temp_calib(struct urtwm_softc *);
 static int		urtwm_init(struct urtwm_softc *);
 static void		urtwm_stop(struct urtwm_softc *);
@@ -454,8 +597,6 @@ static void		urtwm_delay(struct urtwm_softc *, int);
 	(((_sc)->sc_parse_rom)((_sc), (_rom)))
 #define urtwm_set_led(_sc, _led, _on) \
 	(((_sc)->sc_set_led)((_sc), (_led), (_on)))
-#define urtwm_get_rssi_cck(_sc, _physt) \
-	(((_sc)->sc_get_rssi_cck)((_sc), (_physt)))
 #define urtwm_power_on(_sc) \
 	(((_sc)->sc_power_on)((_sc)))
 #define urtwm_power_off(_sc) \
@@ -471,7 +612,7 @@ static void		urtwm_delay(struct urtwm_softc *, int);
 #define urtwm_set_band_5ghz(_sc) \
 	(((_sc)->sc_set_band_5ghz)((_sc)))
 
-static struct usb_config urtwm_config[URTWM_N_TRANSFER] = {
+static const struct usb_config urtwm_config[URTWM_N_TRANSFER] = {
 	[URTWM_BULK_RX] = {
 		.type = UE_BULK,
 		.endpoint = UE_ADDR_ANY,
@@ -537,6 +678,30 @@ static struct usb_config urtwm_config[URTWM_N_TRANSFER] = {
 	},
 };
 
+/* Per-device transfer parameters (hint / sysctl name, limits). */
+static const struct urtwm_xfer_param {
+	const char	*name;
+	size_t		off;
+	int		min;
+	int		max;
+	const char	*descr;
+} urtwm_xfer_params[] = {
+	{ "rxbufsz", offsetof(struct urtwm_softc, rx_bufsz),
+	  URTWM_RXBUFSZ, URTWM_RXBUFSZ_MAX, "Rx transfer size (bytes)" },
+	{ "txbufsz", offsetof(struct urtwm_softc, tx_bufsz),
+	  URTWM_TXBUFSZ, URTWM_TXBUFSZ_MAX, "Tx transfer size (bytes)" },
+	{ "rxlistcount", offsetof(struct urtwm_softc, rx_list_count),
+	  1, URTWM_RX_LIST_MAX, "number of Rx buffers" },
+	{ "txlistcount", offsetof(struct urtwm_softc, tx_list_count),
+	  1, URTWM_TX_LIST_MAX, "number of Tx buffers" },
+	{ "txtimeout", offsetof(struct urtwm_softc, tx_timeout),
+	  URTWM_TX_TIMEOUT_MIN, URTWM_TX_TIMEOUT_MAX, "Tx timeout (ms)" },
+	{ "txxfers", offsetof(struct urtwm_softc, tx_xfers),
+	  1, URTWM_TX_XFERS_MAX, "number of Tx transfers per queue" }
+};
+#define URTWM_XFER_PARAM(_sc, _p)	\
+	((int *)((char *)(_sc) + (_p)->off))
+
 static const struct wme_to_queue {
 	uint16_t reg;
 	uint8_t qid;
@@ -578,7 +743,7 @@ urtwm_attach(device_t self)
 	struct usb_attach_arg *uaa = device_get_ivars(self);
 	struct urtwm_softc *sc = device_get_softc(self);
 	struct ieee80211com *ic = &sc->sc_ic;
-	int error;
+	int error, i, ratectl, val;
 
 	device_set_usb_desc(self);
 	sc->sc_flags = URTWM_RXCKSUM_EN | URTWM_RXCKSUM6_EN;
@@ -588,6 +753,41 @@ urtwm_attach(device_t self)
 	if (USB_GET_DRIVER_INFO(uaa) == URTWM_RTL8812A)
 		sc->chip |= URTWM_CHIP_12A;
 
+	sc->sc_ratectl = URTWM_RATECTL_NET80211;
+	if (resource_int_value(device_get_name(sc->sc_dev),
+	    device_get_unit(sc->sc_dev), "ratectl", &ratectl) == 0 &&
+	    ratectl >= URTWM_RATECTL_NONE && ratectl <= URTWM_RATECTL_MAX)
+		sc->sc_ratectl = ratectl;
+
+	sc->calib_idle_pps = URTWM_CALIB_IDLE_PPS;
+	sc->calib_deadline = URTWM_CALIB_DEADLINE;
+	sc->dig_enable = 1;
+	sc->edca_turbo_enable = 1;
+	sc->rxagg_enable = 1;
+	sc->rxagg_level = URTWM_RXAGG_MID;
+	sc->pwrtrk_enable = 1;
+	sc->bgscan_dwell = URTWM_BGSCAN_DWELL;
+	sc->mon_fltmap[0] = sc->mon_fltmap[1] = sc->mon_fltmap[2] = 0xffff;
+
+	sc->rx_bufsz = URTWM_RXBUFSZ;
+	sc->tx_bufsz = URTWM_TXBUFSZ;
+	sc->rx_list_count = URTWM_RX_LIST_COUNT;
+	sc->tx_list_count = URTWM_TX_LIST_COUNT;
+	sc->tx_timeout = URTWM_TX_TIMEOUT;
+	sc->tx_xfers = URTWM_TX_XFERS;
+	sc->tx_direct_enable = 1;
+	if (resource_int_value(device_get_name(sc->sc_dev),
+	    device_get_unit(sc->sc_dev), "txdirect", &val) == 0)
+		sc->tx_direct_enable = (val != 0);
+	for (i = 0; i < nitems(urtwm_xfer_params); i++) {
+		const struct urtwm_xfer_param *p = &urtwm_xfer_params[i];
+
+		if (resource_int_value(device_get_name(sc->sc_dev),
+		    device_get_unit(sc->sc_dev), p->name, &val) == 0 &&
+		    val >= p->min && val <= p->max)
+			*URTWM_XFER_PARAM(sc, p) = val;
+	}
+
 #ifdef USB_DEBUG
 	int debug;
 	if (resource_int_value(device_get_name(sc->sc_dev),
@@ -597,12 +797,36 @@ urtwm_attach(device_t self)
 
 	mtx_init(&sc->sc_mtx, device_get_nameunit(self),
 	    MTX_NETWORK_LOCK, MTX_DEF);
-	URTWM_CMDQ_LOCK_INIT(sc);
 	URTWM_NT_LOCK_INIT(sc);
+	sc->survey = malloc(sizeof(*sc->survey) *
+	    (nitems(urtwm_chan_2ghz) + nitems(urtwm_chan_5ghz)), M_DEVBUF,
+	    M_WAITOK | M_ZERO);
+	sc->survey_idx = -1;
 	callout_init(&sc->sc_calib_to, 0);
 	callout_init(&sc->sc_pwrmode_init, 0);
+	callout_init(&sc->sc_bgscan_to, 0);
 	mbufq_init(&sc->sc_snd, ifqmaxlen);
 
+	sc->rxtq_cpu = -1;
+	sc->rxtq_limit = URTWM_RXTQ_LIMIT;
+	if (resource_int_value(device_get_name(sc->sc_dev),
+	    device_get_unit(sc->sc_dev), "rxtq", &val) == 0)
+		sc->rxtq_enable = (val != 0);
+	if (resource_int_value(device_get_name(sc->sc_dev),
+	    device_get_unit(sc->sc_dev), "rxtq_cpu", &val) == 0 &&
+	    val >= 0 && val <= mp_maxid && !CPU_ABSENT(val))
+		sc->rxtq_cpu = val;
+	if (resource_int_value(device_get_name(sc->sc_dev),
+	    device_get_unit(sc->sc_dev), "rxtq_limit", &val) == 0 &&
+	    val >= URTWM_RXTQ_LIMIT_MIN && val <= URTWM_RXTQ_LIMIT_MAX)
+		sc->rxtq_limit = val;
+	mbufq_init(&sc->sc_rxq, sc->rxtq_limit);
+	if (sc->rxtq_enable) {
+		error = urtwm_rxtq_attach(sc);
+		if (error != 0)
+			goto detach;
+	}
+
 	error = urtwm_setup_endpoints(sc);
 	if (error != 0)
 		goto detach;
@@ -627,6 +851,7 @@ urtwm_attach(device_t self)
 
 	/* Setup device-specific configuration (after ROM parsing). */
 	urtwm_config_specific_rom(sc);
+	urtwm_rssi_init(sc);
 
 	device_printf(sc->sc_dev, "MAC/BB RTL%sAU, RF 6052 %dT%dR\n",
 	    URTWM_CHIP_IS_12A(sc) ? "8812" : "8821",
@@ -648,9 +873,7 @@ urtwm_attach(device_t self)
 #endif
 		| IEEE80211_C_SHPREAMBLE	/* short preamble supported */
 		| IEEE80211_C_SHSLOT		/* short slot time supported */
-#if 0
 		| IEEE80211_C_BGSCAN		/* capable of bg scanning */
-#endif
 		| IEEE80211_C_WPA		/* 802.11i */
 		| IEEE80211_C_WME		/* 802.11e */
 		| IEEE80211_C_SWAMSDUTX		/* Do software A-MSDU TX */
@@ -676,6 +899,9 @@ urtwm_attach(device_t self)
 	    | IEEE80211_HTC_AMSDU		/* A-MSDU tx */
 	    ;
 
+	/* Reserve space for Tx descriptor. */
+	ic->ic_headroom = sizeof(struct r12a_tx_desc);
+
 	ic->ic_txstream = sc->ntxchains;
 	ic->ic_rxstream = sc->nrxchains;
 
@@ -710,6 +936,7 @@ urtwm_attach(device_t self)
 	sc->sc_node_free = ic->ic_node_free;
 	ic->ic_node_free = urtwm_node_free;
 
+	STAILQ_INIT(&sc->cmdq_run);
 	TASK_INIT(&sc->cmdq_task, 0, urtwm_cmdq_cb, sc);
 
 	urtwm_radiotap_attach(sc);
@@ -739,16 +966,771 @@ urtwm_radiotap_attach(struct urtwm_softc *sc)
 static void
 urtwm_sysctlattach(struct urtwm_softc *sc)
 {
-#ifdef USB_DEBUG
 	struct sysctl_ctx_list *ctx = device_get_sysctl_ctx(sc->sc_dev);
 	struct sysctl_oid *tree = device_get_sysctl_tree(sc->sc_dev);
+	int i;
+
+	SYSCTL_ADD_PROC(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "ratectl", CTLTYPE_INT | CTLFLAG_RW, sc, 0,
+	    urtwm_sysctl_ratectl, "I",
+	    "rate control (0 - fixed, 1 - net80211 (f/w reports), "
+	    "2 - driver)");
+
+	tree = SYSCTL_ADD_NODE(ctx,
+	    SYSCTL_CHILDREN(device_get_sysctl_tree(sc->sc_dev)), OID_AUTO,
+	    "xfer", CTLFLAG_RD, NULL,
+	    "USB transfer parameters (interface must be down to change)");
+	for (i = 0; i < nitems(urtwm_xfer_params); i++) {
+		SYSCTL_ADD_PROC(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+		    urtwm_xfer_params[i].name, CTLTYPE_INT | CTLFLAG_RW, sc, i,
+		    urtwm_sysctl_xfer, "I", urtwm_xfer_params[i].descr);
+	}
+	SYSCTL_ADD_INT(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "txdirect", CTLFLAG_RW, &sc->tx_direct_enable, 0,
+	    "send frames from mbuf storage when possible");
+	SYSCTL_ADD_U64(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "tx_direct", CTLFLAG_RD, &sc->tx_direct, 0,
+	    "frames sent without copying");
+	SYSCTL_ADD_U64(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "tx_copied", CTLFLAG_RD, &sc->tx_copied, 0,
+	    "frames copied into the transfer buffer");
+
+	tree = SYSCTL_ADD_NODE(ctx,
+	    SYSCTL_CHILDREN(device_get_sysctl_tree(sc->sc_dev)), OID_AUTO,
+	    "cmdq", CTLFLAG_RD, NULL, "command queue statistics");
+	SYSCTL_ADD_UINT(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "depth", CTLFLAG_RD, __DEVOLATILE(u_int *, &sc->cmdq_depth), 0,
+	    "commands waiting for execution");
+	SYSCTL_ADD_UINT(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "depth_max", CTLFLAG_RD, &sc->cmdq_depth_max, 0,
+	    "maximal queue depth");
+	SYSCTL_ADD_UINT(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "enqueued", CTLFLAG_RD, &sc->cmdq_enqueued, 0,
+	    "commands enqueued");
+	SYSCTL_ADD_UINT(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "coalesced", CTLFLAG_RD, &sc->cmdq_coalesced, 0,
+	    "commands merged with already pending ones");
+	SYSCTL_ADD_UINT(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "dropped", CTLFLAG_RD, &sc->cmdq_dropped, 0,
+	    "commands dropped (queue limit / no memory)");
+	SYSCTL_ADD_U64(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "executed", CTLFLAG_RD, &sc->cmdq_executed, 0,
+	    "commands executed");
+	SYSCTL_ADD_U64(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "latency_total", CTLFLAG_RD, &sc->cmdq_lat_total, 0,
+	    "total enqueue to execution latency (usec)");
+	SYSCTL_ADD_U64(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "latency_max", CTLFLAG_RD, &sc->cmdq_lat_max, 0,
+	    "maximal enqueue to execution latency (usec)");
+
+	tree = SYSCTL_ADD_NODE(ctx,
+	    SYSCTL_CHILDREN(device_get_sysctl_tree(sc->sc_dev)), OID_AUTO,
+	    "keys", CTLFLAG_RD, NULL, "key table statistics");
+	SYSCTL_ADD_UINT(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "demoted", CTLFLAG_RD, &sc->cam_demoted, 0,
+	    "pairwise keys moved to software crypto");
+	SYSCTL_ADD_UINT(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "promoted", CTLFLAG_RD, &sc->cam_promoted, 0,
+	    "pairwise keys moved back to the key table");
+	SYSCTL_ADD_UINT(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "full", CTLFLAG_RD, &sc->cam_full, 0,
+	    "keys installed in software (no idle slots)");
+
+	tree = SYSCTL_ADD_NODE(ctx,
+	    SYSCTL_CHILDREN(device_get_sysctl_tree(sc->sc_dev)), OID_AUTO,
+	    "calib", CTLFLAG_RD, NULL, "calibration scheduler");
+	SYSCTL_ADD_UINT(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "idle_pps", CTLFLAG_RW, &sc->calib_idle_pps, 0,
+	    "max Rx + Tx packets/s for link to be considered idle");
+	SYSCTL_ADD_UINT(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "deadline", CTLFLAG_RW, &sc->calib_deadline, 0,
+	    "max calibration delay (seconds)");
+	SYSCTL_ADD_UINT(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "deferred", CTLFLAG_RD, &sc->calib_deferred, 0,
+	    "calibrations postponed");
+	SYSCTL_ADD_UINT(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "forced", CTLFLAG_RD, &sc->calib_forced, 0,
+	    "calibrations run due to deadline");
+	SYSCTL_ADD_UINT(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "done", CTLFLAG_RD, &sc->calib_done, 0,
+	    "calibrations done");
+	SYSCTL_ADD_U64(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "blocked_total", CTLFLAG_RD, &sc->calib_blocked_total, 0,
+	    "total time traffic was blocked (usec)");
+	SYSCTL_ADD_U64(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "blocked_max", CTLFLAG_RD, &sc->calib_blocked_max, 0,
+	    "maximal time traffic was blocked (usec)");
+	SYSCTL_ADD_UINT(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "iqk_hits", CTLFLAG_RD, &sc->iqk_hits, 0,
+	    "IQ calibration results restored from cache");
+	SYSCTL_ADD_UINT(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "iqk_misses", CTLFLAG_RD, &sc->iqk_misses, 0,
+	    "channel switches without cached IQ calibration results");
+	SYSCTL_ADD_INT(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "pwrtrk", CTLFLAG_RW, &sc->pwrtrk_enable, 0,
+	    "compensate Tx power for temperature drift");
+	SYSCTL_ADD_S8(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "pwrtrk_delta", CTLFLAG_RD, &sc->pwrtrk_delta, 0,
+	    "current Tx power correction (0.5 dB steps)");
+	SYSCTL_ADD_UINT(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "pwrtrk_updates", CTLFLAG_RD, &sc->pwrtrk_updates, 0,
+	    "Tx power corrections applied");
+
+	tree = SYSCTL_ADD_NODE(ctx,
+	    SYSCTL_CHILDREN(device_get_sysctl_tree(sc->sc_dev)), OID_AUTO,
+	    "dig", CTLFLAG_RD, NULL, "dynamic initial gain");
+	SYSCTL_ADD_INT(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "enable", CTLFLAG_RW, &sc->dig_enable, 0,
+	    "adjust initial gain / CCK PD threshold");
+	SYSCTL_ADD_U8(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "igi", CTLFLAG_RD, &sc->dig_igi, 0, "current initial gain");
+	SYSCTL_ADD_U8(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "cck_pd", CTLFLAG_RD, &sc->dig_cck_pd, 0,
+	    "current CCK packet detection threshold");
+	SYSCTL_ADD_UINT(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "fa_ofdm", CTLFLAG_RD, &sc->dig_fa_ofdm, 0,
+	    "OFDM false alarms (last period)");
+	SYSCTL_ADD_UINT(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "fa_cck", CTLFLAG_RD, &sc->dig_fa_cck, 0,
+	    "CCK false alarms (last period)");
+
+	tree = device_get_sysctl_tree(sc->sc_dev);
+	SYSCTL_ADD_INT(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "edca_turbo", CTLFLAG_RW, &sc->edca_turbo_enable, 0,
+	    "use aggressive BE parameters for single-flow traffic");
+	SYSCTL_ADD_UINT(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "edca_turbo_on", CTLFLAG_RD, &sc->edca_turbo_on, 0,
+	    "number of times EDCA turbo was enabled");
+
+	tree = SYSCTL_ADD_NODE(ctx,
+	    SYSCTL_CHILDREN(device_get_sysctl_tree(sc->sc_dev)), OID_AUTO,
+	    "rxagg", CTLFLAG_RD, NULL, "USB Rx aggregation");
+	SYSCTL_ADD_INT(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "adaptive", CTLFLAG_RW, &sc->rxagg_enable, 0,
+	    "adjust thresholds to the traffic pattern");
+	SYSCTL_ADD_INT(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "level", CTLFLAG_RD, &sc->rxagg_level, 0,
+	    "current level (0 - low, 1 - mid, 2 - high)");
+	SYSCTL_ADD_UINT(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "changes", CTLFLAG_RD, &sc->rxagg_changes, 0,
+	    "number of threshold updates");
+	SYSCTL_ADD_PROC(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "stats", CTLTYPE_STRING | CTLFLAG_RD, sc, 0,
+	    urtwm_sysctl_rxagg, "A",
+	    "per-level thresholds and achieved frames per transfer");
+	SYSCTL_ADD_UINT(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "carried", CTLFLAG_RD, &sc->rx_carried, 0,
+	    "frames reassembled across transfer boundaries");
+	SYSCTL_ADD_UINT(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "carry_drops", CTLFLAG_RD, &sc->rx_carry_drops, 0,
+	    "truncated frames dropped");
+
+#ifdef USB_DEBUG
+	tree = SYSCTL_ADD_NODE(ctx,
+	    SYSCTL_CHILDREN(device_get_sysctl_tree(sc->sc_dev)), OID_AUTO,
+	    "rssi_bench", CTLFLAG_RD, NULL, "PHY status decoding benchmark");
+	SYSCTL_ADD_PROC(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "run", CTLTYPE_INT | CTLFLAG_RW, sc, 0,
+	    urtwm_sysctl_rssi_bench, "I",
+	    "write 1 to run the benchmark");
+	SYSCTL_ADD_U64(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "frames", CTLFLAG_RD, &sc->rssi_bench_frames, 0,
+	    "frames decoded by each decoder");
+	SYSCTL_ADD_U64(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "ref_ns", CTLFLAG_RD, &sc->rssi_bench_ns_ref, 0,
+	    "reference decoder time (nsec)");
+	SYSCTL_ADD_U64(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "table_ns", CTLFLAG_RD, &sc->rssi_bench_ns_tbl, 0,
+	    "table-driven decoder time (nsec)");
+	SYSCTL_ADD_UINT(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "mismatches", CTLFLAG_RD, &sc->rssi_bench_mismatch, 0,
+	    "descriptors decoded differently");
+#endif
+
+	tree = SYSCTL_ADD_NODE(ctx,
+	    SYSCTL_CHILDREN(device_get_sysctl_tree(sc->sc_dev)), OID_AUTO,
+	    "rxnode", CTLFLAG_RD, NULL, "Rx node lookup");
+	SYSCTL_ADD_U64(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "hits", CTLFLAG_RD, &sc->rxnode_hits, 0,
+	    "nodes found by hardware MACID");
+	SYSCTL_ADD_U64(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "misses", CTLFLAG_RD, &sc->rxnode_misses, 0,
+	    "node table lookups");
+
+	if (sc->sc_rxtq != NULL) {
+		tree = SYSCTL_ADD_NODE(ctx,
+		    SYSCTL_CHILDREN(device_get_sysctl_tree(sc->sc_dev)),
+		    OID_AUTO, "rxtq", CTLFLAG_RD, NULL, "Rx thread");
+		SYSCTL_ADD_INT(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+		    "enable", CTLFLAG_RW, &sc->rxtq_enable, 0,
+		    "process received frames in the Rx thread");
+		SYSCTL_ADD_INT(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+		    "cpu", CTLFLAG_RD, &sc->rxtq_cpu, 0,
+		    "CPU the Rx thread is bound to (-1 - none)");
+		SYSCTL_ADD_INT(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+		    "limit", CTLFLAG_RD, &sc->rxtq_limit, 0,
+		    "max number of queued frames");
+		SYSCTL_ADD_U64(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+		    "queued", CTLFLAG_RD, &sc->rxq_queued, 0,
+		    "frames passed to the Rx thread");
+		SYSCTL_ADD_UINT(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+		    "drops", CTLFLAG_RD, &sc->rxq_drops, 0,
+		    "frames dropped (queue full)");
+		SYSCTL_ADD_UINT(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+		    "depth_max", CTLFLAG_RD, &sc->rxq_depth_max, 0,
+		    "maximal queue depth");
+	}
+
+	tree = SYSCTL_ADD_NODE(ctx,
+	    SYSCTL_CHILDREN(device_get_sysctl_tree(sc->sc_dev)), OID_AUTO,
+	    "chansw", CTLFLAG_RD, NULL, "channel switching");
+	SYSCTL_ADD_UINT(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "count", CTLFLAG_RD, &sc->chansw_count, 0,
+	    "channel switches");
+	SYSCTL_ADD_U64(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "usec", CTLFLAG_RD, &sc->chansw_usec, 0,
+	    "total channel switch time (usec)");
+	SYSCTL_ADD_U64(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "usec_max", CTLFLAG_RD, &sc->chansw_usec_max, 0,
+	    "maximal channel switch time (usec)");
+	SYSCTL_ADD_U64(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "xfers", CTLFLAG_RD, &sc->chansw_xfers, 0,
+	    "control transfers issued during channel switches");
+#ifdef USB_DEBUG
+	SYSCTL_ADD_PROC(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "bench", CTLTYPE_INT | CTLFLAG_RW, sc, 0,
+	    urtwm_sysctl_chansw_bench, "I",
+	    "write 1 to switch through all supported channels "
+	    "(interface must be idle)");
+	SYSCTL_ADD_PROC(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "bench_results", CTLTYPE_STRING | CTLFLAG_RD, sc, 0,
+	    urtwm_sysctl_chansw_bench_res, "A",
+	    "per-channel timings from the last benchmark run");
+#endif
 
+	tree = SYSCTL_ADD_NODE(ctx,
+	    SYSCTL_CHILDREN(device_get_sysctl_tree(sc->sc_dev)), OID_AUTO,
+	    "bgscan", CTLFLAG_RD, NULL, "background scanning");
+	SYSCTL_ADD_UINT(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "dwell", CTLFLAG_RW, &sc->bgscan_dwell, 0,
+	    "max time spent on a foreign channel (ms)");
+	SYSCTL_ADD_UINT(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "offchan", CTLFLAG_RD, &sc->bgscan_offchan, 0,
+	    "number of times BSS channel was left");
+	SYSCTL_ADD_UINT(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "offchan_max", CTLFLAG_RD, &sc->bgscan_offchan_max, 0,
+	    "maximal time away from BSS channel (ms)");
+	SYSCTL_ADD_UINT(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "drain_timeouts", CTLFLAG_RD, &sc->bgscan_drain_timeouts, 0,
+	    "BSS channel was left with non-empty Tx queues");
+
+	tree = SYSCTL_ADD_NODE(ctx,
+	    SYSCTL_CHILDREN(device_get_sysctl_tree(sc->sc_dev)), OID_AUTO,
+	    "survey", CTLFLAG_RD, NULL, "channel survey");
+	SYSCTL_ADD_PROC(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "table", CTLTYPE_STRING | CTLFLAG_RD, sc, 0,
+	    urtwm_sysctl_survey, "A",
+	    "per-channel time, CCA and false alarm counters (collected "
+	    "during scan)");
+	SYSCTL_ADD_PROC(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "clear", CTLTYPE_INT | CTLFLAG_RW, sc, 0,
+	    urtwm_sysctl_survey_clear, "I", "clear survey results");
+
+	tree = SYSCTL_ADD_NODE(ctx,
+	    SYSCTL_CHILDREN(device_get_sysctl_tree(sc->sc_dev)), OID_AUTO,
+	    "monitor", CTLFLAG_RD, NULL, "monitor mode Rx filter");
+	SYSCTL_ADD_PROC(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "profile", CTLTYPE_INT | CTLFLAG_RW, sc, 0,
+	    urtwm_sysctl_mon_profile, "I",
+	    "frames to capture (0 - all, 1 - management, 2 - data, "
+	    "3 - management + data, 4 - control; -1 - custom)");
+	SYSCTL_ADD_PROC(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "mgt", CTLTYPE_INT | CTLFLAG_RW, sc, 0,
+	    urtwm_sysctl_mon_filter, "I",
+	    "management subtypes to capture (bitmap, RXFLTMAP0)");
+	SYSCTL_ADD_PROC(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "ctl", CTLTYPE_INT | CTLFLAG_RW, sc, 1,
+	    urtwm_sysctl_mon_filter, "I",
+	    "control subtypes to capture (bitmap, RXFLTMAP1)");
+	SYSCTL_ADD_PROC(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "data", CTLTYPE_INT | CTLFLAG_RW, sc, 2,
+	    urtwm_sysctl_mon_filter, "I",
+	    "data subtypes to capture (bitmap, RXFLTMAP2)");
+	SYSCTL_ADD_PROC(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "rxerr", CTLTYPE_INT | CTLFLAG_RW, sc, 3,
+	    urtwm_sysctl_mon_filter, "I",
+	    "deliver frames with CRC / ICV errors");
+	SYSCTL_ADD_PROC(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
+	    "bssid", CTLTYPE_STRING | CTLFLAG_RW, sc, 0,
+	    urtwm_sysctl_mon_bssid, "A",
+	    "capture frames from this BSSID only (00:00:00:00:00:00 - any)");
+
+	tree = device_get_sysctl_tree(sc->sc_dev);
+#ifdef USB_DEBUG
 	SYSCTL_ADD_U32(ctx, SYSCTL_CHILDREN(tree), OID_AUTO,
 	    "debug", CTLFLAG_RW, &sc->sc_debug, sc->sc_debug,
 	    "control debugging printfs");
 #endif
 }
 
+static int
+urtwm_sysctl_ratectl(SYSCTL_HANDLER_ARGS)
+{
+	struct urtwm_softc *sc = arg1;
+	int error, val;
+
+	val = sc->sc_ratectl;
+	error = sysctl_handle_int(oidp, &val, 0, req);
+	if (error != 0 || req->newptr == NULL)
+		return (error);
+
+	if (val < URTWM_RATECTL_NONE || val > URTWM_RATECTL_MAX)
+		return (EINVAL);
+
+	URTWM_LOCK(sc);
+	if (sc->sc_ratectl != val) {
+		sc->sc_ratectl = val;
+		urtwm_ra_txq_reset(sc);
+		if (sc->sc_flags & URTWM_RUNNING)
+			urtwm_mrr_init(sc);
+	}
+	URTWM_UNLOCK(sc);
+
+	return (0);
+}
+
+static int
+urtwm_sysctl_xfer(SYSCTL_HANDLER_ARGS)
+{
+	struct urtwm_softc *sc = arg1;
+	const struct urtwm_xfer_param *p = &urtwm_xfer_params[arg2];
+	int error, val;
+
+	val = *URTWM_XFER_PARAM(sc, p);
+	error = sysctl_handle_int(oidp, &val, 0, req);
+	if (error != 0 || req->newptr == NULL)
+		return (error);
+
+	if (val < p->min || val > p->max)
+		return (EINVAL);
+
+	URTWM_LOCK(sc);
+	/* Transfers are reallocated on the next urtwm_init() only. */
+	if (sc->sc_flags & (URTWM_STARTED | URTWM_RUNNING)) {
+		URTWM_UNLOCK(sc);
+		return (EBUSY);
+	}
+	if (*URTWM_XFER_PARAM(sc, p) != val) {
+		*URTWM_XFER_PARAM(sc, p) = val;
+		sc->sc_flags |= URTWM_XFER_RECONF;
+	}
+	URTWM_UNLOCK(sc);
+
+	return (0);
+}
+
+#ifdef USB_DEBUG
+/*
+ * Channel switch benchmark: writing 1 switches through all supported
+ * channels and saves per-channel timings (see 'bench_results').
+ * Refused unless the device is up and idle (no running vaps,
+ * no scan), so no traffic is disrupted.
+ */
+static int
+urtwm_sysctl_chansw_bench(SYSCTL_HANDLER_ARGS)
+{
+	struct urtwm_chansw_bench *old, *res;
+	struct urtwm_softc *sc = arg1;
+	struct ieee80211com *ic = &sc->sc_ic;
+	struct ieee80211_channel *c;
+	sbintime_t start;
+	u_int xfers;
+	int error, i, n, nchans, val;
+
+	val = 0;
+	error = sysctl_handle_int(oidp, &val, 0, req);
+	if (error != 0 || req->newptr == NULL || val == 0)
+		return (error);
+
+	nchans = nitems(urtwm_chan_2ghz) + nitems(urtwm_chan_5ghz);
+	res = malloc(sizeof(*res) * nchans, M_DEVBUF, M_WAITOK | M_ZERO);
+
+	URTWM_LOCK(sc);
+	if (!(sc->sc_flags & URTWM_RUNNING)) {
+		URTWM_UNLOCK(sc);
+		free(res, M_DEVBUF);
+		return (ENXIO);
+	}
+	if (sc->vaps_running != 0 || (ic->ic_flags & IEEE80211_F_SCAN)) {
+		URTWM_UNLOCK(sc);
+		free(res, M_DEVBUF);
+		return (EBUSY);
+	}
+
+	error = 0;
+	n = 0;
+	for (i = 0; i < nchans; i++) {
+		if (i < nitems(urtwm_chan_2ghz)) {
+			c = ieee80211_find_channel_byieee(ic,
+			    urtwm_chan_2ghz[i], IEEE80211_CHAN_G);
+		} else {
+			c = ieee80211_find_channel_byieee(ic,
+			    urtwm_chan_5ghz[i - nitems(urtwm_chan_2ghz)],
+			    IEEE80211_CHAN_A);
+		}
+		if (c == NULL)	/* not allowed by regdomain */
+			continue;
+
+		/*
+		 * Bypass urtwm_set_chan(): neither IQK requests nor
+		 * channel switch statistics should be affected.
+		 */
+		xfers = sc->ctrl_xfers;
+		start = sbinuptime();
+		error = urtwm_chan_program(sc, c);
+		res[n].usec = (sbinuptime() - start) / SBT_1US;
+		res[n].xfers = sc->ctrl_xfers - xfers;
+		res[n].chan = ieee80211_chan2ieee(ic, c);
+		if (error != 0)
+			break;
+		n++;
+	}
+
+	/*
+	 * Return to the operating channel; IQ compensation registers
+	 * were not touched.
+	 */
+	if (urtwm_chan_program(sc, ic->ic_curchan) != 0 && error == 0)
+		error = EIO;
+	if (error == 0) {
+		/* Keep the results; free the previous ones. */
+		old = sc->chansw_bench;
+		sc->chansw_bench = res;
+		sc->chansw_bench_n = n;
+		res = old;
+	}
+	URTWM_UNLOCK(sc);
+
+	free(res, M_DEVBUF);
+
+	return (error);
+}
+
+static int
+urtwm_sysctl_chansw_bench_res(SYSCTL_HANDLER_ARGS)
+{
+	struct urtwm_chansw_bench *res;
+	struct urtwm_softc *sc = arg1;
+	struct sbuf sb;
+	uint64_t total, max;
+	u_int total_xfers;
+	int error, i, n, nchans;
+
+	nchans = nitems(urtwm_chan_2ghz) + nitems(urtwm_chan_5ghz);
+	res = malloc(sizeof(*res) * nchans, M_TEMP, M_WAITOK);
+	URTWM_LOCK(sc);
+	n = sc->chansw_bench_n;
+	if (n != 0)
+		memcpy(res, sc->chansw_bench, sizeof(*res) * n);
+	URTWM_UNLOCK(sc);
+
+	sbuf_new_for_sysctl(&sb, NULL, 128, req);
+	sbuf_printf(&sb, "\nchan      usec  requests");
+	total = max = 0;
+	total_xfers = 0;
+	for (i = 0; i < n; i++) {
+		sbuf_printf(&sb, "\n%4d %9ju %9u", res[i].chan,
+		    (uintmax_t)res[i].usec, res[i].xfers);
+
+		total += res[i].usec;
+		total_xfers += res[i].xfers;
+		if (max < res[i].usec)
+			max = res[i].usec;
+	}
+	if (n != 0) {
+		sbuf_printf(&sb,
+		    "\n%d switches: avg %ju usec (max %ju), avg %u requests",
+		    n, (uintmax_t)(total / n), (uintmax_t)max,
+		    total_xfers / n);
+	}
+	error = sbuf_finish(&sb);
+	sbuf_delete(&sb);
+	free(res, M_TEMP);
+
+	return (error);
+}
+
+/* Per-frame computation replaced by urtwm_get_rssi() (for comparison). */
+static int8_t
+urtwm_get_rssi_ref(struct urtwm_softc *sc, int rate,
+    struct r12a_rx_phystat *stat)
+{
+	int i, rssi;
+
+	if (URTWM_RATE_IS_CCK(rate)) {
+		return (sc->sc_cck_pwdb(stat->cfosho[0],
+		    !!(sc->sc_flags & URTWM_FLAG_CCK_HIPWR)));
+	}
+
+	rssi = 0;
+	for (i = 0; i < sc->nrxchains; i++)
+		rssi += (stat->gain_trsw[i] & 0x7f) - 110;
+
+	return (rssi / sc->nrxchains);
+}
+
+/*
+ * PHY status decode microbenchmark: writing 1 runs a fixed number
+ * of passes over a set of random PHY status descriptors (CCK and OFDM)
+ * with both the table-driven and the reference decoder; results are
+ * exported under the same node.
+ */
+static int
+urtwm_sysctl_rssi_bench(SYSCTL_HANDLER_ARGS)
+{
+	struct urtwm_softc *sc = arg1;
+	struct r12a_rx_phystat physt[64];
+	sbintime_t start;
+	uint64_t ns_ref, ns_tbl;
+	volatile int sum;
+	int error, i, mismatch, pass, rate, val;
+
+	val = 0;
+	error = sysctl_handle_int(oidp, &val, 0, req);
+	if (error != 0 || req->newptr == NULL || val == 0)
+		return (error);
+
+	for (i = 0; i < nitems(physt); i++) {
+		memset(&physt[i], 0, sizeof(physt[i]));
+		physt[i].cfosho[0] = arc4random();
+		physt[i].gain_trsw[0] = arc4random();
+		physt[i].gain_trsw[1] = arc4random();
+	}
+
+	/* Both decoders must agree. */
+	mismatch = 0;
+	for (i = 0; i < nitems(physt); i++) {
+		for (rate = 0; rate < URTWM_RIDX_MCS(0); rate++) {
+			if (urtwm_get_rssi(sc, rate, &physt[i]) !=
+			    urtwm_get_rssi_ref(sc, rate, &physt[i]))
+				mismatch++;
+		}
+	}
+
+	sum = 0;
+	start = sbinuptime();
+	for (pass = 0; pass < URTWM_RSSI_BENCH_PASSES; pass++) {
+		for (i = 0; i < nitems(physt); i++) {
+			rate = (i & 1) ? URTWM_RIDX_CCK1 : URTWM_RIDX_OFDM6;
+			sum += urtwm_get_rssi_ref(sc, rate, &physt[i]);
+		}
+	}
+	ns_ref = (sbinuptime() - start) / SBT_1NS;
+
+	start = sbinuptime();
+	for (pass = 0; pass < URTWM_RSSI_BENCH_PASSES; pass++) {
+		for (i = 0; i < nitems(physt); i++) {
+			rate = (i & 1) ? URTWM_RIDX_CCK1 : URTWM_RIDX_OFDM6;
+			sum += urtwm_get_rssi(sc, rate, &physt[i]);
+		}
+	}
+	ns_tbl = (sbinuptime() - start) / SBT_1NS;
+
+	URTWM_LOCK(sc);
+	sc->rssi_bench_frames =
+	    (uint64_t)URTWM_RSSI_BENCH_PASSES * nitems(physt);
+	sc->rssi_bench_ns_ref = ns_ref;
+	sc->rssi_bench_ns_tbl = ns_tbl;
+	sc->rssi_bench_mismatch = mismatch;
+	URTWM_UNLOCK(sc);
+
+	return (0);
+}
+#endif	/* USB_DEBUG */
+
+static int
+urtwm_sysctl_survey(SYSCTL_HANDLER_ARGS)
+{
+	struct urtwm_softc *sc = arg1;
+	struct urtwm_survey *survey, *s;
+	struct sbuf sb;
+	size_t size;
+	int error, i, n;
+
+	n = nitems(urtwm_chan_2ghz) + nitems(urtwm_chan_5ghz);
+	size = sizeof(*survey) * n;
+	survey = malloc(size, M_TEMP, M_WAITOK);
+	URTWM_LOCK(sc);
+	memcpy(survey, sc->survey, size);
+	URTWM_UNLOCK(sc);
+
+	sbuf_new_for_sysctl(&sb, NULL, 128, req);
+	sbuf_printf(&sb, "\nchan  time(ms)  cca_ofdm   cca_cck   fa_ofdm"
+	    "    fa_cck   cca/s");
+	for (i = 0; i < n; i++) {
+		s = &survey[i];
+		if (s->time == 0)
+			continue;
+
+		sbuf_printf(&sb, "\n%4d %9ju %9ju %9ju %9ju %9ju %7ju",
+		    i < nitems(urtwm_chan_2ghz) ? urtwm_chan_2ghz[i] :
+		    urtwm_chan_5ghz[i - nitems(urtwm_chan_2ghz)],
+		    (uintmax_t)(s->time / 1000), (uintmax_t)s->cca_ofdm,
+		    (uintmax_t)s->cca_cck, (uintmax_t)s->fa_ofdm,
+		    (uintmax_t)s->fa_cck,
+		    (uintmax_t)((s->cca_ofdm + s->cca_cck) * 1000000 /
+		    s->time));
+	}
+	error = sbuf_finish(&sb);
+	sbuf_delete(&sb);
+	free(survey, M_TEMP);
+
+	return (error);
+}
+
+static int
+urtwm_sysctl_survey_clear(SYSCTL_HANDLER_ARGS)
+{
+	struct urtwm_softc *sc = arg1;
+	int error, val;
+
+	val = 0;
+	error = sysctl_handle_int(oidp, &val, 0, req);
+	if (error != 0 || req->newptr == NULL || val == 0)
+		return (error);
+
+	URTWM_LOCK(sc);
+	memset(sc->survey, 0, sizeof(*sc->survey) *
+	    (nitems(urtwm_chan_2ghz) + nitems(urtwm_chan_5ghz)));
+	URTWM_UNLOCK(sc);
+
+	return (0);
+}
+
+static int
+urtwm_sysctl_rxagg(SYSCTL_HANDLER_ARGS)
+{
+	static const char *names[URTWM_RXAGG_NLEVELS] =
+	    { "low", "mid", "high" };
+	struct urtwm_softc *sc = arg1;
+	uint64_t xfers[URTWM_RXAGG_NLEVELS], frames[URTWM_RXAGG_NLEVELS];
+	uint64_t fpx;
+	struct sbuf sb;
+	int error, i, level, size, time;
+
+	URTWM_LOCK(sc);
+	memcpy(xfers, sc->rxagg_xfers, sizeof(xfers));
+	memcpy(frames, sc->rxagg_frames, sizeof(frames));
+	level = sc->rxagg_level;
+	URTWM_UNLOCK(sc);
+
+	sbuf_new_for_sysctl(&sb, NULL, 128, req);
+	sbuf_printf(&sb, "\nlevel  size  time      xfers     frames"
+	    "  frames/xfer");
+	for (i = 0; i < URTWM_RXAGG_NLEVELS; i++) {
+		urtwm_rxagg_thresh(sc, i, &size, &time);
+		fpx = xfers[i] != 0 ? frames[i] * 100 / xfers[i] : 0;
+		sbuf_printf(&sb, "\n%-4s%c %5d %5d %10ju %10ju %9ju.%02ju",
+		    names[i], i == level ? '*' : ' ', size, time,
+		    (uintmax_t)xfers[i], (uintmax_t)frames[i],
+		    (uintmax_t)(fpx / 100), (uintmax_t)(fpx % 100));
+	}
+	error = sbuf_finish(&sb);
+	sbuf_delete(&sb);
+
+	return (error);
+}
+
+static const uint16_t urtwm_mon_profiles[][3] = {
+	{ 0xffff, 0xffff, 0xffff },	/* all frames */
+	{ 0xffff, 0x0000, 0x0000 },	/* management */
+	{ 0x0000, 0x0000, 0xffff },	/* data */
+	{ 0xffff, 0x0000, 0xffff },	/* management + data */
+	{ 0x0000, 0xffff, 0x0000 },	/* control */
+};
+
+static int
+urtwm_sysctl_mon_profile(SYSCTL_HANDLER_ARGS)
+{
+	struct urtwm_softc *sc = arg1;
+	int error, val;
+
+	val = sc->mon_profile;
+	error = sysctl_handle_int(oidp, &val, 0, req);
+	if (error != 0 || req->newptr == NULL)
+		return (error);
+
+	if (val < 0 || val >= nitems(urtwm_mon_profiles))
+		return (EINVAL);
+
+	URTWM_LOCK(sc);
+	memcpy(sc->mon_fltmap, urtwm_mon_profiles[val],
+	    sizeof(sc->mon_fltmap));
+	sc->mon_profile = val;
+	if (sc->sc_flags & URTWM_RUNNING)
+		urtwm_rxfilter_mon(sc);
+	URTWM_UNLOCK(sc);
+
+	return (0);
+}
+
+static int
+urtwm_sysctl_mon_filter(SYSCTL_HANDLER_ARGS)
+{
+	struct urtwm_softc *sc = arg1;
+	int error, val;
+
+	if (arg2 < nitems(sc->mon_fltmap))
+		val = sc->mon_fltmap[arg2];
+	else
+		val = sc->mon_rxerr;
+	error = sysctl_handle_int(oidp, &val, 0, req);
+	if (error != 0 || req->newptr == NULL)
+		return (error);
+
+	if (val < 0 || val > 0xffff)
+		return (EINVAL);
+
+	URTWM_LOCK(sc);
+	if (arg2 < nitems(sc->mon_fltmap)) {
+		sc->mon_fltmap[arg2] = val;
+		sc->mon_profile = -1;
+	} else
+		sc->mon_rxerr = !!val;
+	if (sc->sc_flags & URTWM_RUNNING)
+		urtwm_rxfilter_mon(sc);
+	URTWM_UNLOCK(sc);
+
+	return (0);
+}
+
+static int
+urtwm_sysctl_mon_bssid(SYSCTL_HANDLER_ARGS)
+{
+	struct urtwm_softc *sc = arg1;
+	char buf[3 * IEEE80211_ADDR_LEN];
+	u_int addr[IEEE80211_ADDR_LEN];
+	int error, i;
+
+	snprintf(buf, sizeof(buf), "%6D", sc->mon_bssid, ":");
+	error = sysctl_handle_string(oidp, buf, sizeof(buf), req);
+	if (error != 0 || req->newptr == NULL)
+		return (error);
+
+	if (sscanf(buf, "%x:%x:%x:%x:%x:%x", &addr[0], &addr[1], &addr[2],
+	    &addr[3], &addr[4], &addr[5]) != IEEE80211_ADDR_LEN)
+		return (EINVAL);
+
+	URTWM_LOCK(sc);
+	for (i = 0; i < IEEE80211_ADDR_LEN; i++)
+		sc->mon_bssid[i] = addr[i];
+	if (sc->sc_flags & URTWM_RUNNING)
+		urtwm_rxfilter_mon(sc);
+	URTWM_UNLOCK(sc);
+
+	return (0);
+}
+
 static int
 urtwm_detach(device_t self)
 {
@@ -761,11 +1743,19 @@ urtwm_detach(device_t self)
 	URTWM_UNLOCK(sc);
 
 	callout_drain(&sc->sc_calib_to);
+	callout_drain(&sc->sc_bgscan_to);
 
 	urtwm_stop(sc);
 
 	/* stop all USB transfers */
-	usbd_transfer_unsetup(sc->sc_xfer, URTWM_N_TRANSFER);
+	usbd_transfer_unsetup(sc->sc_xfer, URTWM_N_XFER_MAX);
+
+	if (sc->sc_rxtq != NULL) {
+		taskqueue_drain(sc->sc_rxtq, &sc->sc_rxtask);
+		taskqueue_free(sc->sc_rxtq);
+		sc->sc_rxtq = NULL;
+	}
+	urtwm_rxq_drain(sc);
 
 	if (ic->ic_softc == sc) {
 		callout_drain(&sc->sc_pwrmode_init);
@@ -773,9 +1763,12 @@ urtwm_detach(device_t self)
 		ieee80211_ifdetach(ic);
 	}
 
+	urtwm_cmdq_drain(sc);
+
 	URTWM_NT_LOCK_DESTROY(sc);
-	URTWM_CMDQ_LOCK_DESTROY(sc);
 	mtx_destroy(&sc->sc_mtx);
+	free(sc->survey, M_DEVBUF);
+	free(sc->chansw_bench, M_DEVBUF);
 
 	return (0);
 }
@@ -804,6 +1797,7 @@ urtwm_do_request(struct urtwm_softc *sc, struct usb_device_request *req,
 	URTWM_ASSERT_LOCKED(sc);
 
 	while (ntries--) {
+		sc->ctrl_xfers++;
 		err = usbd_do_request_flags(sc->sc_udev, &sc->sc_mtx,
 		    req, data, 0, NULL, 250 /* ms */);
 		if (err == 0)
@@ -1019,6 +2013,7 @@ urtwm_vap_create(struct ieee80211com *ic, const char name[IFNAMSIZ], int unit,
 			urtwm_set_macaddr(sc, vap->iv_myaddr, uvp->id);
 
 		urtwm_rxfilter_update(sc);
+		urtwm_seccfg_update(sc);
 	}
 	URTWM_UNLOCK(sc);
 
@@ -1047,8 +2042,10 @@ urtwm_vap_delete(struct ieee80211vap *vap)
 	urtwm_vap_clear_tx(sc, vap);
 	urtwm_vap_decrement_counters(sc, vap->iv_opmode, uvp->id);
 	urtwm_set_ic_opmode(sc);
-	if (sc->sc_flags & URTWM_RUNNING)
+	if (sc->sc_flags & URTWM_RUNNING) {
 		urtwm_rxfilter_update(sc);
+		urtwm_seccfg_update(sc);
+	}
 	URTWM_UNLOCK(sc);
 
 	if (vap->iv_opmode == IEEE80211_M_IBSS) {
@@ -1065,9 +2062,20 @@ static void
 urtwm_vap_clear_tx(struct urtwm_softc *sc, struct ieee80211vap *vap)
 {
 
+	struct urtwm_data *dp;
+
 	URTWM_ASSERT_LOCKED(sc);
 
-	urtwm_vap_clear_tx_queue(sc, &sc->sc_tx_active, vap);
+	/*
+	 * Buffers of submitted frames are owned by their transfers
+	 * until completion; just drop node references here.
+	 */
+	STAILQ_FOREACH(dp, &sc->sc_tx_active, next) {
+		if (dp->ni != NULL && dp->ni->ni_vap == vap) {
+			ieee80211_free_node(dp->ni);
+			dp->ni = NULL;
+		}
+	}
 	urtwm_vap_clear_tx_queue(sc, &sc->sc_tx_pending, vap);
 }
 
@@ -1087,6 +2095,7 @@ urtwm_vap_clear_tx_queue(struct urtwm_softc *sc, urtwm_datahead *head,
 					m_freem(dp->m);
 					dp->m = NULL;
 				}
+				dp->direct = 0;
 
 				STAILQ_REMOVE(head, dp, urtwm_data, next);
 				STAILQ_INSERT_TAIL(&sc->sc_tx_inactive, dp,
@@ -1134,10 +2143,12 @@ urtwm_rx_copy_to_mbuf(struct urtwm_softc *sc, struct r92c_rx_stat *stat,
 		return (NULL);
 
 	rxdw0 = le32toh(stat->rxdw0);
-	if (__predict_false(rxdw0 & (R92C_RXDW0_CRCERR | R92C_RXDW0_ICVERR))) {
+	if (__predict_false(rxdw0 & (R92C_RXDW0_CRCERR | R92C_RXDW0_ICVERR)) &&
+	    !(sc->mon_rxerr && URTWM_MON_ONLY(sc))) {
 		/*
 		 * This should not happen since we setup our Rx filter
-		 * to not receive these frames.
+		 * to not receive these frames (unless they were requested
+		 * for monitor mode).
 		 */
 		URTWM_DPRINTF(sc, URTWM_DEBUG_RECV,
 		    "%s: RX flags error (%s)\n", __func__,
@@ -1202,23 +2213,35 @@ urtwm_report_intr(struct urtwm_softc *sc, struct usb_xfer *xfer,
 	struct r92c_rx_stat *stat;
 	uint8_t *buf;
 	uint32_t rxdw2;
-	int len;
+	int full, len;
 
 	usbd_xfer_status(xfer, &len, NULL, NULL, NULL);
 
-	if (__predict_false(len < sizeof(*stat))) {
-		counter_u64_add(ic->ic_ierrors, 1);
+	/* NB: only a full transfer may end in the middle of a frame. */
+	full = (len == usbd_xfer_max_len(xfer));
+	buf = data->buf;
+
+	/* Continuation of the previous transfer. */
+	if (sc->rx_carry_len != 0 || sc->rx_carry_skip != 0 ||
+	    sc->rx_agg_left != 0) {
+		sc->rxagg_xfers[sc->rxagg_level]++;
+		return (urtwm_rxeof(sc, buf, len, full));
+	}
+
+	if (__predict_false(len < sizeof(*stat))) {
+		counter_u64_add(ic->ic_ierrors, 1);
 		return (NULL);
 	}
 
-	buf = data->buf;
 	stat = (struct r92c_rx_stat *)buf;
 	rxdw2 = le32toh(stat->rxdw2);
 
 	if (rxdw2 & R12A_RXDW2_RPT_C2H)
 		urtwm_c2h_report(sc, (uint8_t *)&stat[1], len - sizeof(*stat));
-	else
-		return (urtwm_rxeof(sc, buf, len));
+	else {
+		sc->rxagg_xfers[sc->rxagg_level]++;
+		return (urtwm_rxeof(sc, buf, len, full));
+	}
 
 	return (NULL);
 }
@@ -1242,6 +2265,9 @@ urtwm_c2h_report(struct urtwm_softc *sc, uint8_t *buf, int len)
 		URTWM_DPRINTF(sc, URTWM_DEBUG_CALIB,
 		    "FW IQ calibration finished\n");
 		sc->sc_flags &= ~URTWM_IQK_RUNNING;
+		/* Cache results for the calibrated channel. */
+		urtwm_cmd_sleepable(sc, &sc->iqk_chan, sizeof(sc->iqk_chan),
+		    urtwm_iqk_save_cb);
 		break;
 	default:
 		device_printf(sc->sc_dev,
@@ -1273,6 +2299,8 @@ urtwm_ratectl_tx_complete(struct urtwm_softc *sc, void *buf, int len)
 	}
 
 	ntries = MS(rpt->txrptb2, R12A_TXRPTB2_RETRY_CNT);
+	sc->edca_tx_rpts++;
+	sc->edca_tx_retries += ntries;
 
 	URTWM_NT_LOCK(sc);
 	ni = sc->node_list[rpt->macid];
@@ -1283,7 +2311,9 @@ urtwm_ratectl_tx_complete(struct urtwm_softc *sc, void *buf, int len)
 		    (rpt->txrptb0 & (R12A_TXRPTB0_RETRY_OVER |
 		    R12A_TXRPTB0_LIFE_EXPIRE)) ? " not" : "", ntries);
 
-		if (rpt->txrptb0 & R12A_TXRPTB0_RETRY_OVER) {
+		if (URTWM_USE_DRV_RATECTL(sc))
+			urtwm_ra_tx_complete(sc, ni, rpt);
+		else if (rpt->txrptb0 & R12A_TXRPTB0_RETRY_OVER) {
 			ieee80211_ratectl_tx_complete(vap, ni,
 			    IEEE80211_RATECTL_TX_FAILURE, &ntries, NULL);
 		} else {
@@ -1304,13 +2334,118 @@ urtwm_ratectl_tx_complete(struct urtwm_softc *sc, void *buf, int len)
 #endif
 }
 
+/*
+ * Complete the frame that was split between transfers
+ * with the head of the current one.
+ */
+static struct mbuf *
+urtwm_rx_carry(struct urtwm_softc *sc, uint8_t **buf, int *len, int full)
+{
+	struct r92c_rx_stat *stat = (struct r92c_rx_stat *)sc->rx_carry;
+	uint32_t rxdw0;
+	int n, pad, pktlen, totlen;
+
+	/* Descriptor may be split too. */
+	if (sc->rx_carry_len < sizeof(*stat)) {
+		n = MIN(sizeof(*stat) - sc->rx_carry_len, *len);
+		memcpy(sc->rx_carry + sc->rx_carry_len, *buf, n);
+		sc->rx_carry_len += n;
+		*buf += n;
+		*len -= n;
+		if (sc->rx_carry_len < sizeof(*stat))
+			goto partial;
+	}
+
+	rxdw0 = le32toh(stat->rxdw0);
+	pktlen = MS(rxdw0, R92C_RXDW0_PKTLEN);
+	totlen = sizeof(*stat) + MS(rxdw0, R92C_RXDW0_INFOSZ) * 8 + pktlen;
+	if (__predict_false(pktlen == 0)) {
+		/* Lost synchronization; drop the rest of the transfer. */
+		urtwm_rx_carry_drop(sc);
+		*len = 0;
+		return (NULL);
+	}
+
+	n = MIN(totlen - sc->rx_carry_len, *len);
+	memcpy(sc->rx_carry + sc->rx_carry_len, *buf, n);
+	sc->rx_carry_len += n;
+	*buf += n;
+	*len -= n;
+	if (sc->rx_carry_len < totlen)
+		goto partial;
+
+	sc->rx_carry_len = 0;
+	sc->rx_carried++;
+	sc->rxagg_frames[sc->rxagg_level]++;
+	sc->rxagg_win_frames++;
+	sc->rxagg_win_bytes += pktlen;
+	if (sc->rx_agg_left != 0)
+		sc->rx_agg_left--;
+
+	/*
+	 * Next chunk is 8-byte aligned; when the transfer ends here,
+	 * padding follows only if the aggregate continues.
+	 */
+	if (*len > 0 || (full && sc->rx_agg_left != 0)) {
+		pad = roundup2(totlen, 8) - totlen;
+		n = MIN(pad, *len);
+		*buf += n;
+		*len -= n;
+		sc->rx_carry_skip = pad - n;
+	}
+
+	return (urtwm_rx_copy_to_mbuf(sc, stat, totlen));
+
+partial:
+	/* The device has ended the aggregate; frame is truncated. */
+	if (!full)
+		urtwm_rx_carry_drop(sc);
+
+	return (NULL);
+}
+
+static void
+urtwm_rx_carry_drop(struct urtwm_softc *sc)
+{
+
+	if (sc->rx_carry_len != 0) {
+		URTWM_DPRINTF(sc, URTWM_DEBUG_RECV,
+		    "%s: dropping %d bytes of a split frame\n", __func__,
+		    sc->rx_carry_len);
+		sc->rx_carry_drops++;
+	}
+	sc->rx_carry_len = 0;
+	sc->rx_carry_skip = 0;
+	sc->rx_agg_left = 0;
+}
+
 static struct mbuf *
-urtwm_rxeof(struct urtwm_softc *sc, uint8_t *buf, int len)
+urtwm_rxeof(struct urtwm_softc *sc, uint8_t *buf, int len, int full)
 {
 	struct r92c_rx_stat *stat;
 	struct mbuf *m, *m0 = NULL;
 	uint32_t rxdw0;
-	int totlen, pktlen, infosz;
+	int n, pad, totlen, pktlen, infosz;
+
+	/* First descriptor holds the number of frames in the aggregate. */
+	if (sc->rx_carry_len == 0 && sc->rx_carry_skip == 0 &&
+	    sc->rx_agg_left == 0 && len >= sizeof(*stat)) {
+		stat = (struct r92c_rx_stat *)buf;
+		sc->rx_agg_left = MAX(MS(le32toh(stat->rxdw2),
+		    R92C_RXDW2_PKTCNT), 1);
+	}
+
+	/* Skip padding left from the previous transfer. */
+	if (sc->rx_carry_skip != 0) {
+		n = MIN(sc->rx_carry_skip, len);
+		sc->rx_carry_skip -= n;
+		buf += n;
+		len -= n;
+	}
+
+	/* Finish the frame started in the previous transfer. */
+	if (sc->rx_carry_len != 0)
+		m0 = m = urtwm_rx_carry(sc, &buf, &len, full);
 
 	/* Process packets. */
 	while (len >= sizeof(*stat)) {
@@ -1318,16 +2453,25 @@ urtwm_rxeof(struct urtwm_softc *sc, uint8_t *buf, int len)
 		rxdw0 = le32toh(stat->rxdw0);
 
 		pktlen = MS(rxdw0, R92C_RXDW0_PKTLEN);
-		if (__predict_false(pktlen == 0))
+		if (__predict_false(pktlen == 0)) {
+			sc->rx_agg_left = 0;
+			len = 0;
 			break;
+		}
 
 		infosz = MS(rxdw0, R92C_RXDW0_INFOSZ) * 8;
 
-		/* Make sure everything fits in xfer. */
+		/* Frame continues in the next transfer. */
 		totlen = sizeof(*stat) + infosz + pktlen;
 		if (totlen > len)
 			break;
 
+		sc->rxagg_frames[sc->rxagg_level]++;
+		sc->rxagg_win_frames++;
+		sc->rxagg_win_bytes += pktlen;
+		if (sc->rx_agg_left != 0)
+			sc->rx_agg_left--;
+
 		if (m0 == NULL)
 			m0 = m = urtwm_rx_copy_to_mbuf(sc, stat, totlen);
 		else {
@@ -1335,17 +2479,168 @@ urtwm_rxeof(struct urtwm_softc *sc, uint8_t *buf, int len)
 			if (m->m_next != NULL)
 				m = m->m_next;
 		}
-
-		/* Next chunk is 8-byte aligned. */
-		if (totlen < len)
-			totlen = roundup2(totlen, 8);
 		buf += totlen;
 		len -= totlen;
+
+		/* Next chunk is 8-byte aligned (see urtwm_rx_carry()). */
+		if (len > 0 || (full && sc->rx_agg_left != 0)) {
+			pad = roundup2(totlen, 8) - totlen;
+			n = MIN(pad, len);
+			sc->rx_carry_skip = pad - n;
+			buf += n;
+			len -= n;
+		}
+	}
+
+	/* Short transfer ends the aggregate. */
+	if (!full)
+		sc->rx_agg_left = 0;
+
+	/* Keep the tail until the next transfer. */
+	if (len > 0) {
+		if (full) {
+			memcpy(sc->rx_carry, buf, len);
+			sc->rx_carry_len = len;
+		} else {
+			URTWM_DPRINTF(sc, URTWM_DEBUG_RECV,
+			    "%s: truncated frame (%d bytes)\n", __func__, len);
+			sc->rx_carry_drops++;
+		}
 	}
 
 	return (m0);
 }
 
+/*
+ * ieee80211_find_rxnode() replacement for data frames: use the MACID
+ * matched by hardware to avoid node table lookup.
+ */
+static struct ieee80211_node *
+urtwm_rx_find_node(struct urtwm_softc *sc, struct ieee80211_frame_min *wh,
+    uint32_t rxdw1)
+{
+	struct ieee80211_node *ni;
+	u_int macid, refcnt;
+
+	macid = MS(rxdw1, R92C_RXDW1_MACID);
+	if ((wh->i_fc[0] & IEEE80211_FC0_TYPE_MASK) !=
+	    IEEE80211_FC0_TYPE_DATA || macid > URTWM_MACID_MAX(sc))
+		goto slow;
+
+	/* NB: urtwm_node_free() clears node_list[] entries. */
+	URTWM_NT_LOCK(sc);
+	ni = sc->node_list[macid];
+	if (ni == NULL || ni->ni_table == NULL ||
+	    !IEEE80211_ADDR_EQ(ni->ni_macaddr, wh->i_addr2)) {
+		URTWM_NT_UNLOCK(sc);
+		goto slow;
+	}
+
+	/* Do not resurrect a node that is being freed. */
+	do {
+		refcnt = ni->ni_refcnt;
+	} while (refcnt != 0 &&
+	    !atomic_cmpset_int(&ni->ni_refcnt, refcnt, refcnt + 1));
+	URTWM_NT_UNLOCK(sc);
+
+	if (refcnt != 0) {
+		sc->rxnode_hits++;
+		return (ni);
+	}
+
+slow:
+	sc->rxnode_misses++;
+	return (ieee80211_find_rxnode(&sc->sc_ic, wh));
+}
+
+/*
+ * Export the Rx descriptor / PHY status contents to net80211.
+ */
+static void
+urtwm_rx_params(struct urtwm_softc *sc, struct mbuf *m, int8_t rssi,
+    struct r12a_rx_phystat *physt)
+{
+	struct ieee80211_channel *c = sc->sc_ic.ic_curchan;
+	struct ieee80211_rx_stats rxs;
+	struct r92c_rx_stat *stat;
+	uint32_t rxdw0, rxdw1, rxdw4;
+	int i, nf, rate;
+
+	stat = mtod(m, struct r92c_rx_stat *);
+	rxdw0 = le32toh(stat->rxdw0);
+	rxdw1 = le32toh(stat->rxdw1);
+	rxdw4 = le32toh(stat->rxdw4);
+	rate = MS(le32toh(stat->rxdw3), R92C_RXDW3_RATE);
+	nf = URTWM_NOISE_FLOOR;
+
+	memset(&rxs, 0, sizeof(rxs));
+	rxs.r_flags = IEEE80211_R_NF | IEEE80211_R_RSSI;
+	rxs.c_nf = nf;
+	rxs.c_rssi = rssi - nf;
+
+	/* Per-chain RSSI (OFDM only). */
+	if (physt != NULL && !URTWM_RATE_IS_CCK(rate)) {
+		rxs.r_flags |= IEEE80211_R_C_CHAIN | IEEE80211_R_C_NF |
+		    IEEE80211_R_C_RSSI;
+		rxs.c_chain = sc->nrxchains;
+		for (i = 0; i < sc->nrxchains; i++) {
+			rxs.c_nf_ctl[i] = nf;
+			rxs.c_rssi_ctl[i] =
+			    (physt->gain_trsw[i] & 0x7f) - 110 - nf;
+		}
+	}
+
+	if (URTWM_RATE_IS_CCK(rate)) {
+		rxs.c_pktflags |= IEEE80211_RX_F_CCK;
+		rxs.c_rate = ridx2rate[rate];
+	} else if (rate < URTWM_RIDX_MCS(0)) {
+		rxs.c_pktflags |= IEEE80211_RX_F_OFDM;
+		rxs.c_rate = ridx2rate[rate];
+	} else if (rate < URTWM_RIDX_VHT_MCS(0, 0)) {
+		rxs.c_pktflags |= IEEE80211_RX_F_HT;
+		rxs.c_rate = IEEE80211_RATE_MCS | (rate - URTWM_RIDX_MCS(0));
+	} else {
+		rxs.c_pktflags |= IEEE80211_RX_F_VHT;
+		rxs.c_rate = (rate - URTWM_RIDX_VHT_MCS(0, 0)) % 10;
+		rxs.c_vhtnss = (rate - URTWM_RIDX_VHT_MCS(0, 0)) / 10 + 1;
+	}
+	if (rate >= URTWM_RIDX_MCS(0)) {
+		if (rxdw4 & R92C_RXDW4_SGI)
+			rxs.c_pktflags |= IEEE80211_RX_F_SHORTGI;
+		if (rxdw4 & R12A_RXDW4_LDPC)
+			rxs.c_pktflags |= IEEE80211_RX_F_LDPC;
+	}
+
+	switch (MS(rxdw4, R12A_RXDW4_BW)) {
+	case R12A_RXDW4_BW40:
+		rxs.c_width = IEEE80211_RX_FW_40MHZ;
+		break;
+	case R12A_RXDW4_BW80:
+		rxs.c_width = IEEE80211_RX_FW_80MHZ;
+		break;
+	default:
+		rxs.c_width = IEEE80211_RX_FW_20MHZ;
+		break;
+	}
+
+	if (rxdw1 & R12A_RXDW1_PAGGR)
+		rxs.c_pktflags |= IEEE80211_RX_F_AMPDU;
+	/* NB: IV / MIC are left in place by hardware. */
+	if (m->m_flags & M_WEP)
+		rxs.c_pktflags |= IEEE80211_RX_F_DECRYPTED;
+	if (rxdw0 & R92C_RXDW0_CRCERR)
+		rxs.c_pktflags |= IEEE80211_RX_F_FAIL_FCSCRC;
+
+	rxs.r_flags |= IEEE80211_R_FREQ | IEEE80211_R_IEEE;
+	rxs.c_freq = c->ic_freq;
+	rxs.c_ieee = c->ic_ieee;
+
+	rxs.r_flags |= IEEE80211_R_TSF32;
+	rxs.c_rx_tsf = le32toh(stat->rxdw5);
+
+	(void)ieee80211_add_rx_params(m, &rxs);
+}
+
 static struct ieee80211_node *
 urtwm_rx_frame(struct urtwm_softc *sc, struct mbuf *m, int8_t *rssi)
 {
@@ -1354,12 +2649,13 @@ urtwm_rx_frame(struct urtwm_softc *sc, struct mbuf *m, int8_t *rssi)
 	struct ieee80211_frame_min *wh;
 	struct urtwm_node *un;
 	struct r92c_rx_stat *stat;
-	uint32_t rxdw0, rxdw3;
+	uint32_t rxdw0, rxdw1, rxdw3;
 	uint8_t rate, cipher;
-	int infosz;
+	int ac, infosz;
 
 	stat = mtod(m, struct r92c_rx_stat *);
 	rxdw0 = le32toh(stat->rxdw0);
+	rxdw1 = le32toh(stat->rxdw1);
 	rxdw3 = le32toh(stat->rxdw3);
 
 	rate = MS(rxdw3, R92C_RXDW3_RATE);
@@ -1372,11 +2668,41 @@ urtwm_rx_frame(struct urtwm_softc *sc, struct mbuf *m, int8_t *rssi)
 	    cipher != R92C_CAM_ALGO_NONE)
 		m->m_flags |= M_WEP;
 
-	if (m->m_len >= sizeof(*wh))
-		ni = ieee80211_find_rxnode(ic, wh);
+	if (m->m_len >= sizeof(*wh) &&
+	    !(rxdw0 & (R92C_RXDW0_CRCERR | R92C_RXDW0_ICVERR)))
+		ni = urtwm_rx_find_node(sc, wh, rxdw1);
 	else
 		ni = NULL;
 	un = URTWM_NODE(ni);
+	sc->calib_rx_pkts++;
+
+	if (rxdw0 & R92C_RXDW0_QOS)
+		ac = TID_TO_WME_AC(MS(rxdw1, R12A_RXDW1_TID));
+	else
+		ac = WME_AC_BE;
+	sc->edca_rx_bytes[ac] += MS(rxdw0, R92C_RXDW0_PKTLEN);
+	sc->edca_rx_frames++;
+
+	/*
+	 * QoS data may belong to an Rx BA agreement even when received
+	 * as a single MPDU; management, control and non-QoS data frames
+	 * never go through the reorder buffer.
+	 */
+	if (ni != NULL && (ni->ni_flags & IEEE80211_NODE_HT) &&
+	    IEEE80211_QOS_HAS_SEQ(wh))
+		m->m_flags |= M_AMPDU;
+
+	if (un != NULL) {
+		un->key_active = ticks;
+
+		/* Try to move the key back to the CAM. */
+		if (un->key_sw && un->id != URTWM_MACID_UNDEFINED &&
+		    ticks - un->key_retry > un->key_backoff) {
+			un->key_retry = ticks;
+			urtwm_cmd_sleepable(sc, &un->id, sizeof(un->id),
+			    urtwm_key_promote_cb);
+		}
+	}
 
 	/* Get RSSI from PHY status descriptor if present. */
 	if (infosz != 0 && (rxdw0 & R92C_RXDW0_PHYST)) {
@@ -1397,6 +2723,8 @@ urtwm_rx_frame(struct urtwm_softc *sc, struct mbuf *m, int8_t *rssi)
 		tap->wr_flags = 0;
 		if (le32toh(stat->rxdw4) & R92C_RXDW4_SGI)
 			tap->wr_flags |= IEEE80211_RADIOTAP_F_SHORTGI;
+		if (rxdw0 & R92C_RXDW0_CRCERR)
+			tap->wr_flags |= IEEE80211_RADIOTAP_F_BADFCS;
 
 		if (ni != NULL)
 			id = URTWM_VAP(ni->ni_vap)->id;
@@ -1421,6 +2749,10 @@ urtwm_rx_frame(struct urtwm_softc *sc, struct mbuf *m, int8_t *rssi)
 		tap->wr_dbm_antnoise = URTWM_NOISE_FLOOR;
 	}
 
+	urtwm_rx_params(sc, m, *rssi,
+	    (infosz != 0 && (rxdw0 & R92C_RXDW0_PHYST)) ?
+	    (struct r12a_rx_phystat *)&stat[1] : NULL);
+
 	/* Drop descriptor. */
 	m_adj(m, sizeof(*stat) + infosz);
 
@@ -1432,10 +2764,8 @@ urtwm_bulk_rx_callback(struct usb_xfer *xfer, usb_error_t error)
 {
 	struct urtwm_softc *sc = usbd_xfer_softc(xfer);
 	struct ieee80211com *ic = &sc->sc_ic;
-	struct ieee80211_node *ni;
 	struct mbuf *m = NULL, *next;
 	struct urtwm_data *data;
-	int8_t nf, rssi;
 
 	URTWM_ASSERT_LOCKED(sc);
 
@@ -1461,6 +2791,17 @@ tr_setup:
 		    usbd_xfer_max_len(xfer));
 		usbd_transfer_submit(xfer);
 
+		/*
+		 * Let the Rx thread (if any) do the rest; keep using it
+		 * until already queued frames are processed, so they
+		 * will not be overtaken.
+		 */
+		if (m != NULL && sc->sc_rxtq != NULL &&
+		    (sc->rxtq_enable || sc->rxtq_busy)) {
+			urtwm_rxq_enqueue(sc, m);
+			break;
+		}
+
 		/*
 		 * To avoid LOR we should unlock our private mutex here to call
 		 * ieee80211_input() because here is at the end of a USB
@@ -1469,22 +2810,7 @@ tr_setup:
 		while (m != NULL) {
 			next = m->m_next;
 			m->m_next = NULL;
-
-			ni = urtwm_rx_frame(sc, m, &rssi);
-
-			URTWM_UNLOCK(sc);
-
-			nf = URTWM_NOISE_FLOOR;
-			if (ni != NULL) {
-				if (ni->ni_flags & IEEE80211_NODE_HT)
-					m->m_flags |= M_AMPDU;
-				(void)ieee80211_input(ni, m, rssi - nf, nf);
-				ieee80211_free_node(ni);
-			} else {
-				(void)ieee80211_input_all(ic, m,
-				    rssi - nf, nf);
-			}
-			URTWM_LOCK(sc);
+			urtwm_rx_input(sc, m);
 			m = next;
 		}
 		break;
@@ -1495,6 +2821,8 @@ tr_setup:
 			STAILQ_REMOVE_HEAD(&sc->sc_rx_active, next);
 			STAILQ_INSERT_TAIL(&sc->sc_rx_inactive, data, next);
 		}
+		/* Rx stream is broken. */
+		urtwm_rx_carry_drop(sc);
 		if (error != USB_ERR_CANCELLED) {
 			usbd_xfer_set_stall(xfer);
 			counter_u64_add(ic->ic_ierrors, 1);
@@ -1520,14 +2848,237 @@ finish:
 	urtwm_start(sc);
 }
 
+/* Pass the frame to net80211; consumes the node reference. */
+static void
+urtwm_rx_deliver(struct urtwm_softc *sc, struct ieee80211_node *ni,
+    struct mbuf *m, int8_t rssi)
+{
+	struct ieee80211com *ic = &sc->sc_ic;
+	int8_t nf;
+
+	nf = URTWM_NOISE_FLOOR;
+	if (ieee80211_get_rx_params_ptr(m) != NULL) {
+		/* Use Rx parameters attached by urtwm_rx_params(). */
+		if (ni != NULL) {
+			(void)ieee80211_input_mimo(ni, m);
+			ieee80211_free_node(ni);
+		} else
+			(void)ieee80211_input_mimo_all(ic, m);
+	} else if (ni != NULL) {
+		(void)ieee80211_input(ni, m, rssi - nf, nf);
+		ieee80211_free_node(ni);
+	} else
+		(void)ieee80211_input_all(ic, m, rssi - nf, nf);
+}
+
+/* Process the descriptor and pass the frame to net80211; drops the lock. */
+static void
+urtwm_rx_input(struct urtwm_softc *sc, struct mbuf *m)
+{
+	struct ieee80211_node *ni;
+	int8_t rssi;
+
+	URTWM_ASSERT_LOCKED(sc);
+
+	ni = urtwm_rx_frame(sc, m, &rssi);
+
+	urtwm_rx_enter(sc);
+	URTWM_UNLOCK(sc);
+	urtwm_rx_deliver(sc, ni, m, rssi);
+	URTWM_LOCK(sc);
+	urtwm_rx_exit(sc);
+}
+
+/*
+ * Software crypto state of the keys is used by net80211 input
+ * without the driver lock; frames are not passed to net80211
+ * while it is changed by the driver (see urtwm_rx_block()).
+ */
+static void
+urtwm_rx_enter(struct urtwm_softc *sc)
+{
+	URTWM_ASSERT_LOCKED(sc);
+
+	while (sc->rx_keyblk != 0)
+		mtx_sleep(&sc->rx_keyblk, &sc->sc_mtx, 0, "urtwm_rxk", 0);
+	sc->rx_td = curthread;
+}
+
+static void
+urtwm_rx_exit(struct urtwm_softc *sc)
+{
+	URTWM_ASSERT_LOCKED(sc);
+
+	sc->rx_td = NULL;
+	if (sc->rx_keyblk != 0)
+		wakeup(&sc->rx_td);
+}
+
+/*
+ * Wait until net80211 input is done with the current frame(s);
+ * must not be called with the node table lock held.  Frames are
+ * delivered by one thread at a time; key updates made from that
+ * thread (from within net80211 input) do not need to wait.
+ */
+static void
+urtwm_rx_block(struct urtwm_softc *sc)
+{
+	URTWM_ASSERT_LOCKED(sc);
+
+	sc->rx_keyblk++;
+	while (sc->rx_td != NULL && sc->rx_td != curthread)
+		mtx_sleep(&sc->rx_td, &sc->sc_mtx, 0, "urtwm_rxb", 0);
+}
+
+static void
+urtwm_rx_unblock(struct urtwm_softc *sc)
+{
+	URTWM_ASSERT_LOCKED(sc);
+
+	KASSERT(sc->rx_keyblk > 0, ("%s: not blocked", __func__));
+	if (--sc->rx_keyblk == 0)
+		wakeup(&sc->rx_keyblk);
+}
+
+/*
+ * Process descriptors and queue frames for the Rx thread; the node
+ * reference and RSSI are kept in the packet header.
+ */
+static void
+urtwm_rxq_enqueue(struct urtwm_softc *sc, struct mbuf *m)
+{
+	struct ieee80211_node *ni;
+	struct mbuf *next;
+	int8_t rssi;
+	int queued;
+
+	URTWM_ASSERT_LOCKED(sc);
+
+	for (queued = 0; m != NULL; m = next) {
+		next = m->m_next;
+		m->m_next = NULL;
+		ni = urtwm_rx_frame(sc, m, &rssi);
+		m->m_pkthdr.rcvif = (void *)ni;
+		m->m_pkthdr.PH_loc.eight[0] = (uint8_t)rssi;
+		if (mbufq_enqueue(&sc->sc_rxq, m) != 0) {
+			counter_u64_add(sc->sc_ic.ic_ierrors, 1);
+			sc->rxq_drops++;
+			m->m_pkthdr.rcvif = NULL;
+			if (ni != NULL)
+				ieee80211_free_node(ni);
+			m_freem(m);
+		} else
+			queued++;
+	}
+
+	if (mbufq_len(&sc->sc_rxq) > sc->rxq_depth_max)
+		sc->rxq_depth_max = mbufq_len(&sc->sc_rxq);
+	if (queued != 0) {
+		sc->rxq_queued += queued;
+		sc->rxtq_busy = 1;
+		taskqueue_enqueue(sc->sc_rxtq, &sc->sc_rxtask);
+	}
+}
+
+static void
+urtwm_rxq_drain(struct urtwm_softc *sc)
+{
+	struct ieee80211_node *ni;
+	struct mbuf *m;
+
+	while ((m = mbufq_dequeue(&sc->sc_rxq)) != NULL) {
+		ni = (struct ieee80211_node *)m->m_pkthdr.rcvif;
+		m->m_pkthdr.rcvif = NULL;
+		if (ni != NULL)
+			ieee80211_free_node(ni);
+		m_freem(m);
+	}
+}
+
+/*
+ * Rx thread: runs net80211 input processing (without the driver lock)
+ * while the USB callback thread handles the next transfer.
+ */
+static void
+urtwm_rxq_task(void *arg, int pending)
+{
+	struct urtwm_softc *sc = arg;
+	struct ieee80211_node *ni;
+	struct mbuf *m, *next;
+	int8_t rssi;
+
+	URTWM_LOCK(sc);
+	while ((m = mbufq_flush(&sc->sc_rxq)) != NULL) {
+		urtwm_rx_enter(sc);
+		URTWM_UNLOCK(sc);
+		for (; m != NULL; m = next) {
+			next = m->m_nextpkt;
+			m->m_nextpkt = NULL;
+			ni = (struct ieee80211_node *)m->m_pkthdr.rcvif;
+			m->m_pkthdr.rcvif = NULL;
+			rssi = (int8_t)m->m_pkthdr.PH_loc.eight[0];
+			urtwm_rx_deliver(sc, ni, m, rssi);
+		}
+		URTWM_LOCK(sc);
+		urtwm_rx_exit(sc);
+	}
+	sc->rxtq_busy = 0;
+	URTWM_UNLOCK(sc);
+}
+
+static int
+urtwm_rxtq_attach(struct urtwm_softc *sc)
+{
+	const char *name = device_get_nameunit(sc->sc_dev);
+	cpuset_t mask;
+	int error;
+
+	TASK_INIT(&sc->sc_rxtask, 0, urtwm_rxq_task, sc);
+	sc->sc_rxtq = taskqueue_create("urtwm_rx", M_WAITOK,
+	    taskqueue_thread_enqueue, &sc->sc_rxtq);
+	if (sc->rxtq_cpu != -1) {
+		CPU_SETOF(sc->rxtq_cpu, &mask);
+		error = taskqueue_start_threads_cpuset(&sc->sc_rxtq, 1,
+		    PI_NET, &mask, "%s rx", name);
+	} else {
+		error = taskqueue_start_threads(&sc->sc_rxtq, 1, PI_NET,
+		    "%s rx", name);
+	}
+	if (error != 0) {
+		device_printf(sc->sc_dev,
+		    "could not start Rx thread, error %d\n", error);
+		taskqueue_free(sc->sc_rxtq);
+		sc->sc_rxtq = NULL;
+	}
+
+	return (error);
+}
+
 static void
 urtwm_txeof(struct urtwm_softc *sc, struct urtwm_data *data, int status)
 {
 
 	URTWM_ASSERT_LOCKED(sc);
 
+	if (data->direct) {
+		/* Strip Tx descriptor. */
+		m_adj(data->m, sizeof(struct r12a_tx_desc));
+		data->direct = 0;
+	}
+
+	/* Start rate for the Tx report (if the frame reached the device). */
+	if (data->ra_ridx != URTWM_RIDX_UNKNOWN) {
+		if (status == 0 && data->ni != NULL) {
+			urtwm_ra_txq_push(sc, data->ni, data->ra_qsel,
+			    data->ra_ridx);
+		}
+		data->ra_ridx = URTWM_RIDX_UNKNOWN;
+	}
+
 	if (data->ni != NULL)	/* not a beacon frame */
 		ieee80211_tx_complete(data->ni, data->m, status);
+	else if (data->m != NULL)	/* vap was destroyed */
+		m_freem(data->m);
 
 	if (!(sc->sc_flags & URTWM_FW_LOADED))
 		if (sc->sc_tx_n_active > 0)
@@ -1548,6 +3099,7 @@ urtwm_alloc_list(struct urtwm_softc *sc, struct urtwm_data data[],
 	for (i = 0; i < ndata; i++) {
 		struct urtwm_data *dp = &data[i];
 		dp->m = NULL;
+		dp->direct = 0;
 		dp->buf = malloc(maxsz, M_USBDEV, M_NOWAIT);
 		if (dp->buf == NULL) {
 			device_printf(sc->sc_dev,
@@ -1569,15 +3121,25 @@ urtwm_alloc_rx_list(struct urtwm_softc *sc)
 {
         int error, i;
 
-	error = urtwm_alloc_list(sc, sc->sc_rx, URTWM_RX_LIST_COUNT,
-	    URTWM_RXBUFSZ);
+	error = urtwm_alloc_list(sc, sc->sc_rx, sc->rx_list_count,
+	    sc->rx_bufsz);
 	if (error != 0)
 		return (error);
 
+	sc->rx_carry = malloc(URTWM_RX_CARRY_MAX, M_USBDEV, M_NOWAIT);
+	if (sc->rx_carry == NULL) {
+		device_printf(sc->sc_dev, "could not allocate buffer\n");
+		urtwm_free_list(sc, sc->sc_rx, sc->rx_list_count);
+		return (ENOMEM);
+	}
+	sc->rx_carry_len = 0;
+	sc->rx_carry_skip = 0;
+	sc->rx_agg_left = 0;
+
 	STAILQ_INIT(&sc->sc_rx_active);
 	STAILQ_INIT(&sc->sc_rx_inactive);
 
-	for (i = 0; i < URTWM_RX_LIST_COUNT; i++)
+	for (i = 0; i < sc->rx_list_count; i++)
 		STAILQ_INSERT_HEAD(&sc->sc_rx_inactive, &sc->sc_rx[i], next);
 
 	return (0);
@@ -1588,8 +3150,8 @@ urtwm_alloc_tx_list(struct urtwm_softc *sc)
 {
 	int error, i;
 
-	error = urtwm_alloc_list(sc, sc->sc_tx, URTWM_TX_LIST_COUNT,
-	    URTWM_TXBUFSZ);
+	error = urtwm_alloc_list(sc, sc->sc_tx, sc->tx_list_count,
+	    sc->tx_bufsz);
 	if (error != 0)
 		return (error);
 
@@ -1597,7 +3159,7 @@ urtwm_alloc_tx_list(struct urtwm_softc *sc)
 	STAILQ_INIT(&sc->sc_tx_inactive);
 	STAILQ_INIT(&sc->sc_tx_pending);
 
-	for (i = 0; i < URTWM_TX_LIST_COUNT; i++)
+	for (i = 0; i < sc->tx_list_count; i++)
 		STAILQ_INSERT_HEAD(&sc->sc_tx_inactive, &sc->sc_tx[i], next);
 
 	return (0);
@@ -1623,13 +3185,18 @@ urtwm_free_list(struct urtwm_softc *sc, struct urtwm_data data[], int ndata)
 			m_freem(dp->m);
 			dp->m = NULL;
 		}
+		dp->direct = 0;
 	}
 }
 
 static void
 urtwm_free_rx_list(struct urtwm_softc *sc)
 {
-	urtwm_free_list(sc, sc->sc_rx, URTWM_RX_LIST_COUNT);
+	urtwm_free_list(sc, sc->sc_rx, nitems(sc->sc_rx));
+	if (sc->rx_carry != NULL) {
+		free(sc->rx_carry, M_USBDEV);
+		sc->rx_carry = NULL;
+	}
 
 	STAILQ_INIT(&sc->sc_rx_active);
 	STAILQ_INIT(&sc->sc_rx_inactive);
@@ -1638,7 +3205,7 @@ urtwm_free_rx_list(struct urtwm_softc *sc)
 static void
 urtwm_free_tx_list(struct urtwm_softc *sc)
 {
-	urtwm_free_list(sc, sc->sc_tx, URTWM_TX_LIST_COUNT);
+	urtwm_free_list(sc, sc->sc_tx, nitems(sc->sc_tx));
 
 	STAILQ_INIT(&sc->sc_tx_active);
 	STAILQ_INIT(&sc->sc_tx_inactive);
@@ -1649,7 +3216,11 @@ static void
 urtwm_r12a_transfer_submit(struct urtwm_softc *sc, struct usb_xfer *xfer,
     struct urtwm_data *data)
 {
-	usbd_xfer_set_frame_data(xfer, 0, data->buf, data->buflen);
+	if (data->direct) {
+		usbd_xfer_set_frame_data(xfer, 0, mtod(data->m, void *),
+		    data->buflen);
+	} else
+		usbd_xfer_set_frame_data(xfer, 0, data->buf, data->buflen);
 	usbd_transfer_submit(xfer);
 }
 
@@ -1694,10 +3265,11 @@ urtwm_bulk_tx_callback(struct usb_xfer *xfer, usb_error_t error)
 
 	switch (USB_GET_STATE(xfer)){
 	case USB_ST_TRANSFERRED:
-		data = STAILQ_FIRST(&sc->sc_tx_active);
+		data = usbd_xfer_get_priv(xfer);
 		if (data == NULL)
 			goto tr_setup;
-		STAILQ_REMOVE_HEAD(&sc->sc_tx_active, next);
+		usbd_xfer_set_priv(xfer, NULL);
+		STAILQ_REMOVE(&sc->sc_tx_active, data, urtwm_data, next);
 		urtwm_txeof(sc, data, 0);
 		/* FALLTHROUGH */
 	case USB_ST_SETUP:
@@ -1711,15 +3283,17 @@ tr_setup:
 		}
 		STAILQ_REMOVE_HEAD(&sc->sc_tx_pending, next);
 		STAILQ_INSERT_TAIL(&sc->sc_tx_active, data, next);
+		usbd_xfer_set_priv(xfer, data);
 		urtwm_transfer_submit(sc, xfer, data);
 		if (!(sc->sc_flags & URTWM_FW_LOADED))
 			sc->sc_tx_n_active++;
 		break;
 	default:
-		data = STAILQ_FIRST(&sc->sc_tx_active);
+		data = usbd_xfer_get_priv(xfer);
 		if (data == NULL)
 			goto tr_setup;
-		STAILQ_REMOVE_HEAD(&sc->sc_tx_active, next);
+		usbd_xfer_set_priv(xfer, NULL);
+		STAILQ_REMOVE(&sc->sc_tx_active, data, urtwm_data, next);
 		urtwm_txeof(sc, data, 1);
 		if (error != USB_ERR_CANCELLED) {
 			usbd_xfer_set_stall(xfer);
@@ -1762,9 +3336,10 @@ _urtwm_getbuf(struct urtwm_softc *sc)
 	struct urtwm_data *bf;
 
 	bf = STAILQ_FIRST(&sc->sc_tx_inactive);
-	if (bf != NULL)
+	if (bf != NULL) {
 		STAILQ_REMOVE_HEAD(&sc->sc_tx_inactive, next);
-	else {
+		bf->ra_ridx = URTWM_RIDX_UNKNOWN;
+	} else {
 		URTWM_DPRINTF(sc, URTWM_DEBUG_XMIT,
 		    "%s: out of xmit buffers\n", __func__);
 	}
@@ -1944,11 +3519,41 @@ urtwm_fw_cmd(struct urtwm_softc *sc, uint8_t id, const void *buf, int len)
 }
 #endif	/* URTWM_WITHOUT_UCODE */
 
-static void
-urtwm_cmdq_cb(void *arg, int pending)
+/*
+ * Commands without arguments which may be merged with an already
+ * pending instance.
+ */
+static void (* const urtwm_cmdq_coalesce[])(struct urtwm_softc *,
+    union sec_param *) = {
+#ifdef IEEE80211_SUPPORT_SUPERG
+	urtwm_ff_flush_all,
+#endif
+#ifndef URTWM_WITHOUT_UCODE
+	urtwm_set_pwrmode_cb,
+#endif
+	urtwm_update_slot_cb,
+	urtwm_calib_cb,
+	urtwm_edca_turbo_off_cb
+};
+
+static int
+urtwm_cmdq_coalesce_idx(CMD_FUNC_PROTO)
 {
-	struct urtwm_softc *sc = arg;
-	struct urtwm_cmdq *item;
+	int i;
+
+	for (i = 0; i < nitems(urtwm_cmdq_coalesce); i++)
+		if (urtwm_cmdq_coalesce[i] == func)
+			return (i);
+
+	return (-1);
+}
+
+static void
+urtwm_cmdq_cb(void *arg, int pending)
+{
+	struct urtwm_softc *sc = arg;
+	struct urtwm_cmdq *item, *list, *next;
+	uint64_t lat;
 
 	/*
 	 * Device must be powered on (via urtwm_power_on())
@@ -1960,55 +3565,145 @@ urtwm_cmdq_cb(void *arg, int pending)
 		return;
 	}
 
-	URTWM_CMDQ_LOCK(sc);
-	while (sc->cmdq[sc->cmdq_first].func != NULL) {
-		item = &sc->cmdq[sc->cmdq_first];
-		sc->cmdq_first = (sc->cmdq_first + 1) % URTWM_CMDQ_SIZE;
-		URTWM_CMDQ_UNLOCK(sc);
+	for (;;) {
+		if (STAILQ_EMPTY(&sc->cmdq_run)) {
+			/* Grab everything queued so far. */
+			list = (struct urtwm_cmdq *)atomic_readandclear_ptr(
+			    (volatile uintptr_t *)&sc->cmdq_head);
+			if (list == NULL)
+				break;
+
+			/* Restore FIFO order. */
+			for (item = NULL; list != NULL; list = next) {
+				next = list->next;
+				list->next = item;
+				item = list;
+			}
+			for (; item != NULL; item = item->next)
+				STAILQ_INSERT_TAIL(&sc->cmdq_run, item, entry);
+		}
+
+		item = STAILQ_FIRST(&sc->cmdq_run);
+		STAILQ_REMOVE_HEAD(&sc->cmdq_run, entry);
+
+		/* Since now the same command may be queued again. */
+		if (item->cidx != -1)
+			atomic_clear_int(&sc->cmdq_coalesce, 1 << item->cidx);
+
+		lat = (sbinuptime() - item->enq_time) / SBT_1US;
+		sc->cmdq_lat_total += lat;
+		if (sc->cmdq_lat_max < lat)
+			sc->cmdq_lat_max = lat;
+		sc->cmdq_executed++;
 
 		item->func(sc, &item->data);
 
-		URTWM_CMDQ_LOCK(sc);
-		memset(item, 0, sizeof (*item));
+		atomic_subtract_int(&sc->cmdq_depth, 1);
+		free(item, M_USBDEV);
 	}
-	URTWM_CMDQ_UNLOCK(sc);
+
+	/* Write all key changes at once. */
+	if (sc->cam_staged != 0)
+		urtwm_cam_flush(sc);
 	URTWM_UNLOCK(sc);
 }
 
+static void
+urtwm_cmdq_drain(struct urtwm_softc *sc)
+{
+	struct urtwm_cmdq *item, *next;
+
+	while ((item = STAILQ_FIRST(&sc->cmdq_run)) != NULL) {
+		STAILQ_REMOVE_HEAD(&sc->cmdq_run, entry);
+		free(item, M_USBDEV);
+	}
+
+	item = (struct urtwm_cmdq *)atomic_readandclear_ptr(
+	    (volatile uintptr_t *)&sc->cmdq_head);
+	for (; item != NULL; item = next) {
+		next = item->next;
+		free(item, M_USBDEV);
+	}
+
+	sc->cmdq_coalesce = 0;
+	sc->cmdq_depth = 0;
+}
+
 static int
 urtwm_cmd_sleepable(struct urtwm_softc *sc, const void *ptr, size_t len,
     CMD_FUNC_PROTO)
 {
 	struct ieee80211com *ic = &sc->sc_ic;
+	struct urtwm_cmdq *item, *head;
+	u_int bits, depth, max;
+	int idx;
 
 	KASSERT(len <= sizeof(union sec_param), ("buffer overflow"));
 
-	URTWM_CMDQ_LOCK(sc);
-	if (sc->cmdq[sc->cmdq_last].func != NULL) {
+	/* Merge with already pending instance, if possible. */
+	idx = (ptr == NULL) ? urtwm_cmdq_coalesce_idx(func) : -1;
+	if (idx != -1) {
+		do {
+			bits = sc->cmdq_coalesce;
+			if (bits & (1 << idx)) {
+				atomic_add_int(&sc->cmdq_coalesced, 1);
+				return (0);
+			}
+		} while (!atomic_cmpset_int(&sc->cmdq_coalesce, bits,
+		    bits | (1 << idx)));
+	}
+
+	depth = atomic_fetchadd_int(&sc->cmdq_depth, 1) + 1;
+	if (depth > URTWM_CMDQ_MAX_DEPTH) {
 		device_printf(sc->sc_dev, "%s: cmdq overflow\n", __func__);
-		URTWM_CMDQ_UNLOCK(sc);
+		goto fail;
+	}
 
-		return (EAGAIN);
+	item = malloc(sizeof(*item), M_USBDEV, M_NOWAIT | M_ZERO);
+	if (item == NULL) {
+		device_printf(sc->sc_dev, "%s: could not allocate command\n",
+		    __func__);
+		goto fail;
 	}
 
+	do {
+		max = sc->cmdq_depth_max;
+	} while (max < depth &&
+	    !atomic_cmpset_int(&sc->cmdq_depth_max, max, depth));
+
 	if (ptr != NULL)
-		memcpy(&sc->cmdq[sc->cmdq_last].data, ptr, len);
-	sc->cmdq[sc->cmdq_last].func = func;
-	sc->cmdq_last = (sc->cmdq_last + 1) % URTWM_CMDQ_SIZE;
-	URTWM_CMDQ_UNLOCK(sc);
+		memcpy(&item->data, ptr, len);
+	item->func = func;
+	item->cidx = idx;
+	item->enq_time = sbinuptime();
+
+	do {
+		head = sc->cmdq_head;
+		item->next = head;
+	} while (!atomic_cmpset_rel_ptr((volatile uintptr_t *)&sc->cmdq_head,
+	    (uintptr_t)head, (uintptr_t)item));
+	atomic_add_int(&sc->cmdq_enqueued, 1);
 
 	ieee80211_runtask(ic, &sc->cmdq_task);
 
 	return (0);
+
+fail:
+	atomic_subtract_int(&sc->cmdq_depth, 1);
+	if (idx != -1)
+		atomic_clear_int(&sc->cmdq_coalesce, 1 << idx);
+	atomic_add_int(&sc->cmdq_dropped, 1);
+
+	return (EAGAIN);
 }
 
-static void
+static usb_error_t
 urtwm_rf_write(struct urtwm_softc *sc, int chain, uint8_t addr,
     uint32_t val)
 {
-	urtwm_bb_write(sc, R12A_LSSI_PARAM(chain),
+	return (urtwm_bb_write(sc, R12A_LSSI_PARAM(chain),
 	    SM(R88E_LSSI_PARAM_ADDR, addr) |
-	    SM(R92C_LSSI_PARAM_DATA, val));
+	    SM(R92C_LSSI_PARAM_DATA, val)));
 }
 
 static uint32_t
@@ -2254,9 +3949,10 @@ urtwm_efuse_switch_power(struct urtwm_softc *sc)
 static int
 urtwm_setup_endpoints(struct urtwm_softc *sc)
 {
+	struct usb_config *cfg = sc->sc_xfer_config;
 	struct usb_endpoint *ep, *ep_end;
 	uint8_t addr[R12A_MAX_EPOUT];
-	int error;
+	int error, i;
 
 	/* Determine the number of bulk-out pipes. */
 	sc->ntx = 0;
@@ -2291,31 +3987,55 @@ urtwm_setup_endpoints(struct urtwm_softc *sc)
 	}
 
 	/* NB: keep in sync with urtwm_dma_init(). */
-	urtwm_config[URTWM_BULK_TX_VO].endpoint = addr[0];
+	memcpy(cfg, urtwm_config, sizeof(urtwm_config));
+	cfg[URTWM_BULK_TX_VO].endpoint = addr[0];
 	switch (sc->ntx) {
 	case 4:
 	case 3:
-		urtwm_config[URTWM_BULK_TX_BE].endpoint = addr[2];
-		urtwm_config[URTWM_BULK_TX_BK].endpoint = addr[2];
-		urtwm_config[URTWM_BULK_TX_VI].endpoint = addr[1];
+		cfg[URTWM_BULK_TX_BE].endpoint = addr[2];
+		cfg[URTWM_BULK_TX_BK].endpoint = addr[2];
+		cfg[URTWM_BULK_TX_VI].endpoint = addr[1];
 		break;
 	case 2:
-		urtwm_config[URTWM_BULK_TX_BE].endpoint = addr[1];
-		urtwm_config[URTWM_BULK_TX_BK].endpoint = addr[1];
-		urtwm_config[URTWM_BULK_TX_VI].endpoint = addr[0];
+		cfg[URTWM_BULK_TX_BE].endpoint = addr[1];
+		cfg[URTWM_BULK_TX_BK].endpoint = addr[1];
+		cfg[URTWM_BULK_TX_VI].endpoint = addr[0];
 		break;
 	case 1:
-		urtwm_config[URTWM_BULK_TX_BE].endpoint = addr[0];
-		urtwm_config[URTWM_BULK_TX_BK].endpoint = addr[0];
-		urtwm_config[URTWM_BULK_TX_VI].endpoint = addr[0];
+		cfg[URTWM_BULK_TX_BE].endpoint = addr[0];
+		cfg[URTWM_BULK_TX_BK].endpoint = addr[0];
+		cfg[URTWM_BULK_TX_VI].endpoint = addr[0];
 		break;
 	default:
 		KASSERT(1, ("unhandled number of endpoints %d\n", sc->ntx));
 		break;
 	}
 
+	/* Additional Tx transfers share endpoints with the first set. */
+	for (i = URTWM_N_TRANSFER; i < URTWM_N_XFER_MAX; i++)
+		cfg[i] = cfg[URTWM_BULK_TX_BE +
+		    (i - URTWM_BULK_TX_BE) % URTWM_TX_NQUEUES];
+
+	return (urtwm_setup_xfers(sc));
+}
+
+static int
+urtwm_setup_xfers(struct urtwm_softc *sc)
+{
+	struct usb_config *cfg = sc->sc_xfer_config;
+	int error, i;
+
+	for (i = 0; i < URTWM_N_XFER(sc->tx_xfers); i++) {
+		if (i == URTWM_BULK_RX)
+			cfg[i].bufsize = sc->rx_bufsz;
+		else {
+			cfg[i].bufsize = sc->tx_bufsz;
+			cfg[i].timeout = sc->tx_timeout;
+		}
+	}
+
 	error = usbd_transfer_setup(sc->sc_udev, &sc->sc_iface_index,
-	    sc->sc_xfer, urtwm_config, URTWM_N_TRANSFER, sc, &sc->sc_mtx);
+	    sc->sc_xfer, cfg, URTWM_N_XFER(sc->tx_xfers), sc, &sc->sc_mtx);
 	if (error) {
 		device_printf(sc->sc_dev, "could not allocate USB transfers, "
 		    "err=%s\n", usbd_errstr(error));
@@ -2435,7 +4155,7 @@ urtwm_config_specific(struct urtwm_softc *sc)
 			sc->sc_rf_read = urtwm_r12a_rf_read;
 		sc->sc_check_condition = urtwm_r12a_check_condition;
 		sc->sc_parse_rom = urtwm_r12a_parse_rom;
-		sc->sc_get_rssi_cck = urtwm_r12a_get_rssi_cck;
+		sc->sc_cck_pwdb = urtwm_r12a_cck_pwdb;
 		sc->sc_power_on = urtwm_r12a_power_on;
 		sc->sc_power_off = urtwm_r12a_power_off;
 #ifndef URTWM_WITHOUT_UCODE
@@ -2471,7 +4191,7 @@ urtwm_config_specific(struct urtwm_softc *sc)
 		sc->sc_rf_read = urtwm_r21a_rf_read;
 		sc->sc_check_condition = urtwm_r21a_check_condition;
 		sc->sc_parse_rom = urtwm_r21a_parse_rom;
-		sc->sc_get_rssi_cck = urtwm_r21a_get_rssi_cck;
+		sc->sc_cck_pwdb = urtwm_r21a_cck_pwdb;
 		sc->sc_power_on = urtwm_r21a_power_on;
 		sc->sc_power_off = urtwm_r21a_power_off;
 #ifndef URTWM_WITHOUT_UCODE
@@ -2561,6 +4281,9 @@ urtwm_read_rom(struct urtwm_softc *sc)
 	/* Parse & save data in softc. */
 	urtwm_parse_rom(sc, rom);
 
+	/* Precompute per-rate Tx power for all channel groups. */
+	urtwm_init_txpower(sc);
+
 fail:
 	free(rom, M_TEMP);
 
@@ -2777,6 +4500,382 @@ rate2ridx(uint8_t rate)
 	}
 }
 
+static __inline uint8_t
+urtwm_ridx2rate(uint8_t ridx)
+{
+	if (ridx >= URTWM_RIDX_MCS(0))
+		return (IEEE80211_RATE_MCS | (ridx - URTWM_RIDX_MCS(0)));
+
+	return (ridx2rate[ridx]);
+}
+
+/*
+ * Driver-side rate control.
+ *
+ * Per-rate success probability is kept as an EWMA updated every
+ * URTWM_RA_UPDATE_INTERVAL; the rate with the best expected throughput
+ * starts the chain and hardware fallback (DARFRC) walks it down to
+ * the most robust rate.  Every URTWM_RA_PROBE_INTERVAL frames some
+ * faster rate is probed.  Feedback comes from firmware Tx reports;
+ * when they are not available (no firmware) rate is derived from RSSI.
+ */
+
+/* Nominal PHY rates (100 Kbps units); MCS rates are for HT20, long GI. */
+static const uint16_t urtwm_ra_phyrate[URTWM_RIDX_COUNT] = {
+	10, 20, 55, 110,				/* CCK */
+	60, 90, 120, 180, 240, 360, 480, 540,		/* OFDM */
+	65, 130, 195, 260, 390, 520, 585, 650,		/* MCS0-7 */
+	130, 260, 390, 520, 780, 1040, 1170, 1300	/* MCS8-15 */
+};
+
+/* Minimal RSSI (dBm) for each rate (used without Tx reports). */
+static const int8_t urtwm_ra_min_rssi[URTWM_RIDX_COUNT] = {
+	-90, -88, -86, -84,
+	-86, -85, -83, -81, -78, -74, -70, -68,
+	-86, -83, -80, -77, -73, -69, -67, -65,
+	-83, -80, -77, -74, -70, -66, -64, -62
+};
+
+static void
+urtwm_ra_node_init(struct urtwm_softc *sc, struct ieee80211_node *ni)
+{
+	struct urtwm_node *un = URTWM_NODE(ni);
+	struct urtwm_ra_node *ra = &un->ra;
+	const struct ieee80211_rateset *rs = &ni->ni_rates;
+	const struct ieee80211_htrateset *rs_ht = &ni->ni_htrates;
+	uint8_t mcs, ridx;
+	int i;
+
+	URTWM_ASSERT_LOCKED(sc);
+
+	memset(ra, 0, sizeof(*ra));
+
+	if (ni->ni_flags & IEEE80211_NODE_HT) {
+		for (i = 0; i < rs_ht->rs_nrates; i++) {
+			mcs = rs_ht->rs_rates[i] & IEEE80211_RATE_VAL;
+			if (mcs >= 8 * sc->ntxchains || mcs > 15)
+				continue;
+			ra->rates |= 1 << URTWM_RIDX_MCS(mcs);
+		}
+	}
+	if (ra->rates == 0) {
+		for (i = 0; i < rs->rs_nrates; i++) {
+			ridx = rate2ridx(rs->rs_rates[i] & IEEE80211_RATE_VAL);
+			if (ridx != URTWM_RIDX_UNKNOWN)
+				ra->rates |= 1 << ridx;
+		}
+	}
+	if (ra->rates == 0)
+		return;
+
+	ra->lowest = ffs(ra->rates) - 1;
+	ra->max_tp = urtwm_ra_rssi_rate(ra, un->last_rssi);
+	ra->max_prob = ra->lowest;
+	ra->probe_next = ra->lowest;
+	ra->last_update = ticks;
+
+	URTWM_DPRINTF(sc, URTWM_DEBUG_RA,
+	    "%s: macid %d, rates 0x%07x, initial ridx %d\n",
+	    __func__, un->id, ra->rates, ra->max_tp);
+}
+
+/* Deferred from urtwm_newassoc() (called with net80211 lock held). */
+static void
+urtwm_ra_node_init_cb(struct urtwm_softc *sc, union sec_param *data)
+{
+	struct ieee80211_node *ni;
+
+	URTWM_ASSERT_LOCKED(sc);
+
+	URTWM_NT_LOCK(sc);
+	ni = sc->node_list[data->macid];
+	if (ni != NULL)
+		urtwm_ra_node_init(sc, ni);
+	URTWM_NT_UNLOCK(sc);
+}
+
+/*
+ * Select the fastest usable rate for the given signal level.
+ */
+static uint8_t
+urtwm_ra_rssi_rate(struct urtwm_ra_node *ra, int8_t rssi)
+{
+	uint8_t ridx, best;
+
+	best = ra->lowest;
+	if (rssi == 0)		/* not measured yet */
+		return (best);
+
+	for (ridx = 0; ridx < URTWM_RIDX_COUNT; ridx++) {
+		if (!(ra->rates & (1 << ridx)))
+			continue;
+		if (rssi >= urtwm_ra_min_rssi[ridx] &&
+		    urtwm_ra_phyrate[ridx] > urtwm_ra_phyrate[best])
+			best = ridx;
+	}
+
+	return (best);
+}
+
+static void
+urtwm_ra_update(struct urtwm_softc *sc, struct urtwm_ra_node *ra)
+{
+	struct urtwm_ra_stats *st;
+	uint32_t prob;
+	uint8_t ridx, max_tp, max_prob;
+
+	URTWM_ASSERT_LOCKED(sc);
+
+	ra->last_update = ticks;
+	max_tp = max_prob = ra->lowest;
+
+	for (ridx = 0; ridx < URTWM_RIDX_COUNT; ridx++) {
+		if (!(ra->rates & (1 << ridx)))
+			continue;
+
+		st = &ra->stats[ridx];
+		if (st->attempts != 0) {
+			prob = (st->success << URTWM_RA_SCALE_SHIFT) /
+			    st->attempts;
+			if (st->att_total == 0)
+				st->prob = prob;
+			else {
+				st->prob = (st->prob * URTWM_RA_EWMA_LEVEL +
+				    prob * (100 - URTWM_RA_EWMA_LEVEL)) / 100;
+			}
+			st->att_total += st->attempts;
+			st->attempts = st->success = 0;
+		}
+		if (st->att_total == 0)
+			continue;
+
+		/* Rates with < 10% success are useless. */
+		if (st->prob < URTWM_RA_ONE / 10)
+			st->tput = 0;
+		else {
+			st->tput = (urtwm_ra_phyrate[ridx] * st->prob) >>
+			    URTWM_RA_SCALE_SHIFT;
+		}
+
+		if (st->tput > ra->stats[max_tp].tput)
+			max_tp = ridx;
+
+		if (st->prob > ra->stats[max_prob].prob ||
+		    (st->prob == ra->stats[max_prob].prob &&
+		     st->tput > ra->stats[max_prob].tput))
+			max_prob = ridx;
+	}
+
+	/* Keep the current selection until there is some feedback. */
+	if (ra->stats[max_tp].tput == 0)
+		return;
+
+	ra->max_tp = max_tp;
+	ra->max_prob = max_prob;
+}
+
+/*
+ * Returns rate index for the next data frame; *fb_lmt is set to
+ * the number of fallback steps hardware is allowed to take.
+ */
+static uint8_t
+urtwm_ra_get_rate(struct urtwm_softc *sc, struct ieee80211_node *ni,
+    uint8_t *fb_lmt)
+{
+	struct urtwm_node *un = URTWM_NODE(ni);
+	struct urtwm_ra_node *ra = &un->ra;
+	uint8_t ridx, floor, i;
+	int n;
+
+	URTWM_ASSERT_LOCKED(sc);
+
+	if (ra->rates == 0) {
+		/* Not associated yet (or no usable rates). */
+		*fb_lmt = 0x1f;
+		return (URTWM_RIDX_UNKNOWN);
+	}
+
+	if (ticks - ra->last_update >= URTWM_RA_UPDATE_INTERVAL) {
+		if (ra->nreports == 0) {
+			/* No Tx reports - follow the signal level. */
+			ra->last_update = ticks;
+			ra->max_tp = urtwm_ra_rssi_rate(ra, un->last_rssi);
+		} else
+			urtwm_ra_update(sc, ra);
+	}
+
+	ridx = ra->max_tp;
+	floor = ra->max_prob;
+
+	/*
+	 * Probe some faster rate from time to time (only when we are
+	 * getting feedback and the link is not congested).
+	 */
+	if (ra->nreports != 0 &&
+	    ++ra->nframes >= URTWM_RA_PROBE_INTERVAL &&
+	    ra->queue_time < (URTWM_RA_QUEUE_TIME_MAX <<
+	    URTWM_RA_SCALE_SHIFT)) {
+		ra->nframes = 0;
+		for (i = 0; i < URTWM_RIDX_COUNT; i++) {
+			ra->probe_next = (ra->probe_next + 1) %
+			    URTWM_RIDX_COUNT;
+			if (!(ra->rates & (1 << ra->probe_next)) ||
+			    ra->probe_next == ridx)
+				continue;
+			if (urtwm_ra_phyrate[ra->probe_next] <=
+			    urtwm_ra_phyrate[ridx])
+				continue;
+
+			ridx = ra->probe_next;
+			floor = ra->max_tp;
+			break;
+		}
+	}
+
+	if (floor > ridx)
+		floor = ra->lowest;
+
+	/* Number of usable rates between start and the chain floor. */
+	for (n = 0, i = floor; i < ridx; i++)
+		if (ra->rates & (1 << i))
+			n++;
+	*fb_lmt = MIN(n, R12A_MRR_SIZE);
+
+	ni->ni_txrate = urtwm_ridx2rate(ridx);
+
+	return (ridx);
+}
+
+/* Remove the n-th entry from the Tx report queue. */
+static void
+urtwm_ra_txq_remove(struct urtwm_ra_node *ra, int n)
+{
+
+	ra->txq_len--;
+	memmove(&ra->txq[n], &ra->txq[n + 1],
+	    (ra->txq_len - n) * sizeof(ra->txq[0]));
+}
+
+/* Drop entries whose Tx report will never arrive. */
+static void
+urtwm_ra_txq_expire(struct urtwm_ra_node *ra)
+{
+
+	while (ra->txq_len != 0 &&
+	    ticks - ra->txq[0].time > URTWM_RA_TXQ_TIMEOUT)
+		urtwm_ra_txq_remove(ra, 0);
+}
+
+/*
+ * Remember start rate of the frame handed to the device; reports
+ * are matched per Tx queue in order (hardware does not reorder them).
+ */
+static void
+urtwm_ra_txq_push(struct urtwm_softc *sc, struct ieee80211_node *ni,
+    uint8_t qsel, uint8_t ridx)
+{
+	struct urtwm_ra_node *ra = &URTWM_NODE(ni)->ra;
+	struct urtwm_ra_txq *ent;
+
+	URTWM_ASSERT_LOCKED(sc);
+
+	urtwm_ra_txq_expire(ra);
+	if (ra->txq_len == URTWM_RA_TXQ_LEN)
+		urtwm_ra_txq_remove(ra, 0);
+
+	ent = &ra->txq[ra->txq_len++];
+	ent->ridx = ridx;
+	ent->qsel = qsel;
+	ent->time = ticks;
+}
+
+/*
+ * Drop start rates of frames sent with another rate control
+ * or discarded by the device.
+ */
+static void
+urtwm_ra_txq_reset(struct urtwm_softc *sc)
+{
+	struct ieee80211_node *ni;
+	int i;
+
+	URTWM_ASSERT_LOCKED(sc);
+
+	URTWM_NT_LOCK(sc);
+	for (i = 0; i <= URTWM_MACID_MAX(sc); i++) {
+		ni = sc->node_list[i];
+		if (ni != NULL)
+			URTWM_NODE(ni)->ra.txq_len = 0;
+	}
+	URTWM_NT_UNLOCK(sc);
+}
+
+static void
+urtwm_ra_tx_complete(struct urtwm_softc *sc, struct ieee80211_node *ni,
+    const struct r12a_c2h_tx_rpt *rpt)
+{
+	struct urtwm_ra_node *ra = &URTWM_NODE(ni)->ra;
+	uint8_t start, final, qsel, i;
+	int ntries, ok;
+
+	URTWM_ASSERT_LOCKED(sc);
+
+	if (ra->rates == 0)
+		return;
+
+	final = rpt->final_rate;
+	qsel = MS(rpt->txrptb0, R12A_TXRPTB0_QSEL);
+	ntries = MS(rpt->txrptb2, R12A_TXRPTB2_RETRY_CNT);
+	ok = !(rpt->txrptb0 & R12A_TXRPTB0_RETRY_OVER);
+
+	/* Oldest frame from the same Tx queue. */
+	start = final;
+	urtwm_ra_txq_expire(ra);
+	for (i = 0; i < ra->txq_len; i++) {
+		if (ra->txq[i].qsel == qsel) {
+			start = ra->txq[i].ridx;
+			urtwm_ra_txq_remove(ra, i);
+			break;
+		}
+	}
+
+	/* Track how long frames are waiting in the queue. */
+	ra->queue_time = (ra->queue_time * URTWM_RA_EWMA_LEVEL +
+	    (le16toh(rpt->queue_time) << URTWM_RA_SCALE_SHIFT) *
+	    (100 - URTWM_RA_EWMA_LEVEL)) / 100;
+
+	/* The frame was not transmitted at all; not a rate problem. */
+	if (rpt->txrptb0 & R12A_TXRPTB0_LIFE_EXPIRE)
+		return;
+
+	if (final >= URTWM_RIDX_COUNT || !(ra->rates & (1 << final)))
+		return;
+	if (start < final || start >= URTWM_RIDX_COUNT)
+		start = final;
+
+	ra->nreports++;
+
+	/* Every rate above the final one has failed at least once. */
+	for (i = final + 1; i <= start; i++) {
+		if (!(ra->rates & (1 << i)))
+			continue;
+		ra->stats[i].attempts++;
+		if (ntries > 0)
+			ntries--;
+	}
+
+	ra->stats[final].attempts += ntries + 1;
+	ra->stats[final].success += ok;
+
+	URTWM_DPRINTF(sc, URTWM_DEBUG_RA,
+	    "%s: macid %d, start %d, final %d, retries %d, %s\n",
+	    __func__, URTWM_NODE(ni)->id, start, final,
+	    MS(rpt->txrptb2, R12A_TXRPTB2_RETRY_CNT), ok ? "ok" : "failed");
+
+	if (ticks - ra->last_update >= URTWM_RA_UPDATE_INTERVAL)
+		urtwm_ra_update(sc, ra);
+}
+
 #ifdef URTWM_TODO
 /* XXX TODO: provide a sysctl to switch between f/w and net80211 ratectl. */
 /*
@@ -3278,7 +5377,7 @@ urtwm_push_nulldata(struct urtwm_softc *sc, struct ieee80211vap *vap)
 
 	data->buflen = required_size;
 	STAILQ_INSERT_TAIL(&sc->sc_tx_pending, data, next);
-	usbd_transfer_start(sc->sc_xfer[URTWM_BULK_TX_VO]);
+	urtwm_tx_kick(sc, URTWM_BULK_TX_VO);
 
 	error = urtwm_check_beacon_valid(sc, uvp->id);
 	if (error != 0) {
@@ -3396,57 +5495,231 @@ urtwm_set_media_status(struct urtwm_softc *sc, union sec_param *data)
 }
 #endif
 
+/*
+ * Group keys are stored in per-port CAM slots and are looked up
+ * by address (BSSID for STA, broadcast for beaconing vaps) + key id;
+ * broadcast entries of two beaconing vaps would be ambiguous.
+ */
 static int
-urtwm_key_alloc(struct ieee80211vap *vap, struct ieee80211_key *k,
-    ieee80211_keyix *keyix, ieee80211_keyix *rxkeyix)
+urtwm_gkey_offload(struct urtwm_softc *sc, struct ieee80211vap *vap,
+    const struct ieee80211_key *k)
 {
-	struct urtwm_softc *sc = vap->iv_ic->ic_softc;
-	uint8_t i;
 
-	if (!(&vap->iv_nw_keys[0] <= k &&
-	     k < &vap->iv_nw_keys[IEEE80211_WEP_NKID])) {
-		if (!(k->wk_flags & IEEE80211_KEY_SWCRYPT)) {
-			URTWM_LOCK(sc);
-			/*
-			 * Current slot usage:
-			 * everything for pairwise keys.
-			 */
-			for (i = 0; i < R12A_CAM_ENTRY_COUNT; i++) {
-				if ((sc->keys_bmap & (1 << i)) == 0) {
-					sc->keys_bmap |= 1 << i;
-					*keyix = i;
-					break;
-				}
-			}
-			URTWM_UNLOCK(sc);
-			if (i == R12A_CAM_ENTRY_COUNT) {
-				device_printf(sc->sc_dev,
-				    "%s: no free space in the key table\n",
-				    __func__);
-				return 0;
-			}
-		} else
-			*keyix = 0;
-	} else {
-		*keyix = k - vap->iv_nw_keys;
-		/* XXX will be overridden during group key handshake */
-		k->wk_flags |= IEEE80211_KEY_SWCRYPT;
-	}
-	*rxkeyix = *keyix;
-	return 1;
-}
+	URTWM_ASSERT_LOCKED(sc);
 
-static void
-urtwm_key_set_cb(struct urtwm_softc *sc, union sec_param *data)
-{
-	struct ieee80211_key *k = &data->key;
-	uint8_t algo, keyid;
-	int i, error;
+	if (URTWM_VAP(vap)->id == URTWM_VAP_ID_INVALID)
+		return (0);
+	/* Static WEP keys are used for unicast frames too. */
+	if (k->wk_cipher->ic_cipher == IEEE80211_CIPHER_WEP)
+		return (0);
+	if (sc->bcn_vaps > 1)
+		return (0);
 
-	keyid = 0;
+	return (1);
+}
 
-	/* Map net80211 cipher to HW crypto algorithm. */
-	switch (k->wk_cipher->ic_cipher) {
+/*
+ * Returns the station whose pairwise key is programmed into
+ * the CAM slot (if any); the node is valid while nt_mtx is held.
+ */
+static struct ieee80211_node *
+urtwm_key_owner(struct urtwm_softc *sc, int slot)
+{
+	struct ieee80211_node *ni;
+	uint8_t macid;
+
+	mtx_assert(&sc->nt_mtx, MA_OWNED);
+
+	macid = sc->cam_macid[slot];
+	if (macid > URTWM_MACID_MAX(sc))
+		return (NULL);
+
+	ni = sc->node_list[macid];
+	if (ni == NULL || ni->ni_ucastkey.wk_keyix != slot ||
+	    (ni->ni_ucastkey.wk_flags & IEEE80211_KEY_SWCRYPT))
+		return (NULL);
+
+	return (ni);
+}
+
+/*
+ * Returns a pairwise key slot, which can be reused by 'un';
+ * free slots are preferred, then the least recently active
+ * station (idle for at least URTWM_KEY_IDLE_MIN) is chosen.
+ * NB: URTWM_KEY_IDLE_MIN is much larger than the promotion interval,
+ * so a demoted key will not push its replacement out right away.
+ */
+static int
+urtwm_key_lru(struct urtwm_softc *sc, struct urtwm_node *un)
+{
+	struct ieee80211_node *ni;
+	int i, idle, idle_max, slot;
+
+	URTWM_ASSERT_LOCKED(sc);
+	mtx_assert(&sc->nt_mtx, MA_OWNED);
+
+	slot = -1;
+	idle_max = URTWM_KEY_IDLE_MIN;
+	for (i = URTWM_CAM_GKEY_SLOTS; i < R12A_CAM_ENTRY_COUNT; i++) {
+		if ((sc->keys_bmap & (1ULL << i)) == 0)
+			return (i);
+
+		ni = urtwm_key_owner(sc, i);
+		/* Only CCMP keys can be moved between h/w and s/w. */
+		if (ni == NULL || URTWM_NODE(ni) == un ||
+		    ni->ni_ucastkey.wk_cipher->ic_cipher !=
+		    IEEE80211_CIPHER_AES_CCM)
+			continue;
+
+		idle = ticks - URTWM_NODE(ni)->key_active;
+		if (idle >= idle_max) {
+			idle_max = idle;
+			slot = i;
+		}
+	}
+
+	return (slot);
+}
+
+/*
+ * Move pairwise key from the CAM slot to software crypto;
+ * the slot is invalidated with the next CAM flush.
+ */
+static void
+urtwm_key_demote(struct urtwm_softc *sc, int slot)
+{
+	uint32_t words[R92C_CAM_ENTRY_LEN];
+	struct ieee80211_node *ni;
+	struct ieee80211_key *k;
+	struct urtwm_node *un;
+
+	URTWM_ASSERT_LOCKED(sc);
+	mtx_assert(&sc->nt_mtx, MA_OWNED);
+
+	ni = urtwm_key_owner(sc, slot);
+	if (ni != NULL) {
+		k = &ni->ni_ucastkey;
+
+		URTWM_DPRINTF(sc, URTWM_DEBUG_KEY,
+		    "%s: slot %d, macaddr %s\n", __func__, slot,
+		    ether_sprintf(k->wk_macaddr));
+
+		/*
+		 * NB: Tx encapsulation is serialized by the softc lock,
+		 * Rx - by urtwm_rx_block().
+		 */
+		KASSERT(sc->rx_keyblk != 0, ("%s: Rx is not blocked",
+		    __func__));
+		ieee80211_key_update_begin(ni->ni_vap);
+		k->wk_flags |= IEEE80211_KEY_SWCRYPT;
+		(void) k->wk_cipher->ic_setkey(k);
+		ieee80211_key_update_end(ni->ni_vap);
+
+		/* Back off: do not try to promote it for a while. */
+		un = URTWM_NODE(ni);
+		un->key_backoff = MIN(un->key_backoff * 2,
+		    URTWM_KEY_BACKOFF_MAX);
+		un->key_retry = ticks;
+		un->key_sw = 1;
+		sc->cam_demoted++;
+	}
+
+	memset(words, 0, sizeof(words));
+	urtwm_cam_stage(sc, slot, words);
+
+	sc->cam_macid[slot] = URTWM_MACID_UNDEFINED;
+	sc->keys_bmap &= ~(1ULL << slot);
+}
+
+static int
+urtwm_key_alloc(struct ieee80211vap *vap, struct ieee80211_key *k,
+    ieee80211_keyix *keyix, ieee80211_keyix *rxkeyix)
+{
+	struct urtwm_softc *sc = vap->iv_ic->ic_softc;
+
+	if (!(&vap->iv_nw_keys[0] <= k &&
+	     k < &vap->iv_nw_keys[IEEE80211_WEP_NKID])) {
+		if (!(k->wk_flags & IEEE80211_KEY_SWCRYPT)) {
+			struct ieee80211_node *ni;
+			int i;
+
+			ni = __containerof(k, struct ieee80211_node,
+			    ni_ucastkey);
+
+			URTWM_LOCK(sc);
+			urtwm_rx_block(sc);
+			URTWM_NT_LOCK(sc);
+			/*
+			 * Current slot usage:
+			 * 0 - 7: group keys (4 per port);
+			 * everything else for pairwise keys.
+			 */
+			URTWM_NODE(ni)->key_active = ticks;
+			URTWM_NODE(ni)->key_backoff =
+			    URTWM_KEY_PROMOTE_INTERVAL;
+			i = urtwm_key_lru(sc, URTWM_NODE(ni));
+			if (i != -1) {
+				if (sc->keys_bmap & (1ULL << i))
+					urtwm_key_demote(sc, i);
+				sc->keys_bmap |= 1ULL << i;
+				sc->cam_macid[i] = URTWM_NODE(ni)->id;
+				URTWM_NODE(ni)->key_sw = 0;
+				*keyix = i;
+			} else
+				sc->cam_full++;
+			URTWM_NT_UNLOCK(sc);
+			urtwm_rx_unblock(sc);
+			URTWM_UNLOCK(sc);
+
+			if (i == -1) {
+				if (k->wk_cipher->ic_cipher !=
+				    IEEE80211_CIPHER_AES_CCM) {
+					device_printf(sc->sc_dev,
+					    "%s: no free space in the key "
+					    "table\n", __func__);
+					return 0;
+				}
+
+				/* Will be promoted when a slot is freed. */
+				URTWM_DPRINTF(sc, URTWM_DEBUG_KEY,
+				    "%s: key table is full, using s/w crypto "
+				    "for %s\n", __func__,
+				    ether_sprintf(ni->ni_macaddr));
+				k->wk_flags |= IEEE80211_KEY_SWCRYPT;
+				URTWM_NODE(ni)->key_sw = 1;
+				*keyix = 0;
+			}
+		} else
+			*keyix = 0;
+	} else {
+		*keyix = k - vap->iv_nw_keys;
+
+		URTWM_LOCK(sc);
+		if (urtwm_gkey_offload(sc, vap, k)) {
+			*keyix = URTWM_CAM_GKEY_ENTRY(URTWM_VAP(vap)->id,
+			    *keyix);
+		} else
+			k->wk_flags |= IEEE80211_KEY_SWCRYPT;
+		URTWM_UNLOCK(sc);
+	}
+	*rxkeyix = *keyix;
+	return 1;
+}
+
+static void
+urtwm_key_stage(struct urtwm_softc *sc, const struct ieee80211_key *k)
+{
+	uint32_t words[R92C_CAM_ENTRY_LEN];
+	uint8_t algo, keyid;
+	int i;
+
+	if (k->wk_keyix < URTWM_CAM_GKEY_SLOTS)
+		keyid = k->wk_keyix % IEEE80211_WEP_NKID;
+	else
+		keyid = 0;
+
+	/* Map net80211 cipher to HW crypto algorithm. */
+	switch (k->wk_cipher->ic_cipher) {
 	case IEEE80211_CIPHER_WEP:
 		if (k->wk_keylen < 8)
 			algo = R92C_CAM_ALGO_WEP40;
@@ -3471,54 +5744,41 @@ urtwm_key_set_cb(struct urtwm_softc *sc, union sec_param *data)
 	    k->wk_cipher->ic_cipher, algo, k->wk_flags, k->wk_keylen,
 	    ether_sprintf(k->wk_macaddr));
 
-	/* Clear high bits. */
-	urtwm_cam_write(sc, R92C_CAM_CTL6(k->wk_keyix), 0);
-	urtwm_cam_write(sc, R92C_CAM_CTL7(k->wk_keyix), 0);
-
-	/* Write key. */
-	for (i = 0; i < 4; i++) {
-		error = urtwm_cam_write(sc, R92C_CAM_KEY(k->wk_keyix, i),
-		    le32dec(&k->wk_key[i * 4]));
-		if (error != 0)
-			goto fail;
-	}
-
-	/* Write CTL0 last since that will validate the CAM entry. */
-	error = urtwm_cam_write(sc, R92C_CAM_CTL1(k->wk_keyix),
-	    le32dec(&k->wk_macaddr[2]));
-	if (error != 0)
-		goto fail;
-	error = urtwm_cam_write(sc, R92C_CAM_CTL0(k->wk_keyix),
-	    SM(R92C_CAM_ALGO, algo) |
+	/* Build CAM entry; it will be written by urtwm_cam_flush(). */
+	memset(words, 0, sizeof(words));
+	words[0] = SM(R92C_CAM_ALGO, algo) |
 	    SM(R92C_CAM_KEYID, keyid) |
 	    SM(R92C_CAM_MACLO, le16dec(&k->wk_macaddr[0])) |
-	    R92C_CAM_VALID);
-	if (error != 0)
-		goto fail;
+	    R92C_CAM_VALID;
+	words[1] = le32dec(&k->wk_macaddr[2]);
+	for (i = 0; i < 4; i++)
+		words[2 + i] = le32dec(&k->wk_key[i * 4]);
+
+	urtwm_cam_stage(sc, k->wk_keyix, words);
+}
 
-	return;
+static void
+urtwm_key_set_cb(struct urtwm_softc *sc, union sec_param *data)
+{
+	urtwm_key_stage(sc, &data->key);
 
-fail:
-	device_printf(sc->sc_dev, "%s fails, error %d\n", __func__, error);
+	/* The key must be usable when the next command is run. */
+	urtwm_cam_flush(sc);
 }
 
 static void
 urtwm_key_del_cb(struct urtwm_softc *sc, union sec_param *data)
 {
 	struct ieee80211_key *k = &data->key;
-	int i;
+	uint32_t words[R92C_CAM_ENTRY_LEN];
 
 	URTWM_DPRINTF(sc, URTWM_DEBUG_KEY,
 	    "%s: keyix %d, flags %04X, macaddr %s\n", __func__,
 	    k->wk_keyix, k->wk_flags, ether_sprintf(k->wk_macaddr));
 
-	urtwm_cam_write(sc, R92C_CAM_CTL0(k->wk_keyix), 0);
-	urtwm_cam_write(sc, R92C_CAM_CTL1(k->wk_keyix), 0);
-
-	/* Clear key. */
-	for (i = 0; i < 4; i++)
-		urtwm_cam_write(sc, R92C_CAM_KEY(k->wk_keyix, i), 0);
-	sc->keys_bmap &= ~(1 << k->wk_keyix);
+	/* Invalidate the entry and clear the key. */
+	memset(words, 0, sizeof(words));
+	urtwm_cam_stage(sc, k->wk_keyix, words);
 }
 
 static int
@@ -3526,29 +5786,131 @@ urtwm_process_key(struct ieee80211vap *vap, const struct ieee80211_key *k,
     int set)
 {
 	struct urtwm_softc *sc = vap->iv_ic->ic_softc;
+	struct ieee80211_key gkey;
 
 	if (k->wk_flags & IEEE80211_KEY_SWCRYPT) {
+		if (!set && !(&vap->iv_nw_keys[0] <= k &&
+		    k < &vap->iv_nw_keys[IEEE80211_WEP_NKID])) {
+			/* Do not try to promote it anymore. */
+			URTWM_LOCK(sc);
+			URTWM_NODE(__containerof(k, struct ieee80211_node,
+			    ni_ucastkey))->key_sw = 0;
+			URTWM_UNLOCK(sc);
+		}
+
 		/* Not for us. */
 		return (1);
 	}
 
 	if (&vap->iv_nw_keys[0] <= k &&
 	    k < &vap->iv_nw_keys[IEEE80211_WEP_NKID]) {
-		struct ieee80211_key *k1 = &vap->iv_nw_keys[k->wk_keyix];
+		struct ieee80211_key *k1;
+		int offload;
 
-		/*
-		 * Do not offload group keys;
-		 * multicast key search is too problematic with 2+ vaps.
-		 */
-		/* XXX fix net80211 instead */
-		k1->wk_flags |= IEEE80211_KEY_SWCRYPT;
-		return (k->wk_cipher->ic_setkey(k1));
+		k1 = &vap->iv_nw_keys[k - vap->iv_nw_keys];
+
+		URTWM_LOCK(sc);
+		offload = urtwm_gkey_offload(sc, vap, k);
+		URTWM_UNLOCK(sc);
+
+		if (set && !offload) {
+			/* Another beaconing vap was added since key_alloc. */
+			k1->wk_flags |= IEEE80211_KEY_SWCRYPT;
+			return (k->wk_cipher->ic_setkey(k1));
+		}
+
+		/* Address used for CAM search. */
+		gkey = *k;
+		if (vap->iv_opmode == IEEE80211_M_STA)
+			IEEE80211_ADDR_COPY(gkey.wk_macaddr,
+			    vap->iv_bss->ni_bssid);
+		else
+			memset(gkey.wk_macaddr, 0xff, IEEE80211_ADDR_LEN);
+		k = &gkey;
+	} else if (!set) {
+		/* Release the slot; it will be cleared before reuse. */
+		URTWM_LOCK(sc);
+		sc->cam_macid[k->wk_keyix] = URTWM_MACID_UNDEFINED;
+		sc->keys_bmap &= ~(1ULL << k->wk_keyix);
+		URTWM_UNLOCK(sc);
 	}
 
 	return (!urtwm_cmd_sleepable(sc, k, sizeof(*k),
 	    set ? urtwm_key_set_cb : urtwm_key_del_cb));
 }
 
+/* Move demoted pairwise key back to the CAM. */
+static void
+urtwm_key_promote_cb(struct urtwm_softc *sc, union sec_param *data)
+{
+	uint32_t words[R92C_CAM_ENTRY_LEN];
+	struct ieee80211_node *ni;
+	struct ieee80211_key *k;
+	struct urtwm_node *un;
+	union sec_param key;
+	uint8_t macid = data->macid;
+	int slot;
+
+	urtwm_rx_block(sc);
+	URTWM_NT_LOCK(sc);
+	ni = sc->node_list[macid];
+	if (ni == NULL)
+		goto end;
+
+	un = URTWM_NODE(ni);
+	k = &ni->ni_ucastkey;
+	if (!un->key_sw || !(k->wk_flags & IEEE80211_KEY_DEVKEY) ||
+	    k->wk_cipher->ic_cipher != IEEE80211_CIPHER_AES_CCM)
+		goto end;
+
+	slot = urtwm_key_lru(sc, un);
+	if (slot == -1)
+		goto end;
+
+	/* NB: the old key (if any) is overwritten with the same flush. */
+	if (sc->keys_bmap & (1ULL << slot))
+		urtwm_key_demote(sc, slot);
+	sc->keys_bmap |= 1ULL << slot;
+	sc->cam_macid[slot] = macid;
+
+	URTWM_DPRINTF(sc, URTWM_DEBUG_KEY, "%s: slot %d, macaddr %s\n",
+	    __func__, slot, ether_sprintf(k->wk_macaddr));
+
+	key.key = *k;
+	key.key.wk_keyix = key.key.wk_rxkeyix = slot;
+	urtwm_key_stage(sc, &key.key);
+	URTWM_NT_UNLOCK(sc);
+	urtwm_rx_unblock(sc);
+
+	/* Program the entry before Tx path will rely on it. */
+	urtwm_cam_flush(sc);
+
+	/* The key may be deleted while the lock was dropped. */
+	urtwm_rx_block(sc);
+	URTWM_NT_LOCK(sc);
+	ni = sc->node_list[macid];
+	if (ni == NULL || !URTWM_NODE(ni)->key_sw ||
+	    (sc->cam_staged & (1ULL << slot))) {
+		memset(words, 0, sizeof(words));
+		urtwm_cam_stage(sc, slot, words);
+		sc->cam_macid[slot] = URTWM_MACID_UNDEFINED;
+		sc->keys_bmap &= ~(1ULL << slot);
+		goto end;
+	}
+
+	k = &ni->ni_ucastkey;
+	ieee80211_key_update_begin(ni->ni_vap);
+	k->wk_keyix = k->wk_rxkeyix = slot;
+	k->wk_flags &= ~IEEE80211_KEY_SWCRYPT;
+	ieee80211_key_update_end(ni->ni_vap);
+	URTWM_NODE(ni)->key_sw = 0;
+	sc->cam_promoted++;
+
+end:
+	URTWM_NT_UNLOCK(sc);
+	urtwm_rx_unblock(sc);
+}
+
 static int
 urtwm_key_set(struct ieee80211vap *vap, const struct ieee80211_key *k)
 {
@@ -3852,7 +6214,16 @@ urtwm_newstate(struct ieee80211vap *vap, enum ieee80211_state nstate, int arg)
 			/* Stop Rx of data frames. */
 			urtwm_write_2(sc, R92C_RXFLTMAP2, 0);
 
+			/* Restore default Rx aggregation thresholds. */
+			if (sc->rxagg_level != URTWM_RXAGG_MID)
+				urtwm_rxagg_set(sc, URTWM_RXAGG_MID);
+
+			/* Forget noise / interference levels. */
+			urtwm_dig_reset(sc);
+
 			/* Reset EDCA parameters. */
+			sc->edca_turbo = 0;
+			sc->edca_turbo_cnt = 0;
 			urtwm_write_4(sc, R92C_EDCA_VO_PARAM, 0x002f3217);
 			urtwm_write_4(sc, R92C_EDCA_VI_PARAM, 0x005e4317);
 			urtwm_write_4(sc, R92C_EDCA_BE_PARAM, 0x00105320);
@@ -3982,6 +6353,12 @@ urtwm_newstate(struct ieee80211vap *vap, enum ieee80211_state nstate, int arg)
 			/* Reset temperature calibration state machine. */
 			sc->sc_flags &= ~URTWM_TEMP_MEASURED;
 			sc->thcal_temp = sc->thermal_meter;
+			sc->calib_pending = 0;
+			sc->calib_last_temp = ticks - URTWM_CALIB_PERIOD;
+			sc->calib_window = ticks;
+			sc->edca_window = ticks;
+			sc->rxagg_window = ticks;
+			sc->rxagg_cnt = 0;
 
 			/* Start periodic calibration. */
 			callout_reset(&sc->sc_calib_to, 2*hz, urtwm_calib_to,
@@ -4019,24 +6396,215 @@ urtwm_calib_to(void *arg)
 	urtwm_cmd_sleepable(sc, NULL, 0, urtwm_calib_cb);
 }
 
+/*
+ * Run postponed LC/IQ calibration when the link is (almost) idle
+ * or when it cannot be delayed anymore; LCK blocks all Tx queues
+ * for ~150 ms.
+ */
+static void
+urtwm_calib_sched(struct urtwm_softc *sc)
+{
+	sbintime_t start;
+	uint64_t blocked;
+	uint8_t pending;
+	int elapsed, forced, pps;
+
+	URTWM_ASSERT_LOCKED(sc);
+
+	elapsed = ticks - sc->calib_window;
+	if (elapsed <= 0)
+		elapsed = 1;
+	pps = (uint64_t)(sc->calib_tx_pkts + sc->calib_rx_pkts) * hz /
+	    elapsed;
+	sc->calib_tx_pkts = sc->calib_rx_pkts = 0;
+	sc->calib_window = ticks;
+
+	if (sc->calib_pending == 0)
+		return;
+
+	forced = (ticks - sc->calib_since) >= sc->calib_deadline * hz;
+	if (!forced && (pps > sc->calib_idle_pps ||
+	    sc->sc_tx_n_active != 0 || mbufq_len(&sc->sc_snd) != 0)) {
+		URTWM_DPRINTF(sc, URTWM_DEBUG_CALIB,
+		    "%s: postponed (%d pkts/s, %d Tx active)\n", __func__,
+		    pps, sc->sc_tx_n_active);
+		return;
+	}
+
+	URTWM_DPRINTF(sc, URTWM_DEBUG_CALIB,
+	    "%s: running%s (pending %02X, %d pkts/s)\n", __func__,
+	    forced ? " (deadline)" : "", sc->calib_pending, pps);
+
+	pending = sc->calib_pending;
+	sc->calib_pending = 0;
+
+	start = sbinuptime();
+	if (pending & URTWM_CALIB_LCK)
+		urtwm_lc_calib(sc);
+	if (pending & URTWM_CALIB_IQK)
+		urtwm_iq_calib(sc);
+	blocked = (sbinuptime() - start) / SBT_1US;
+
+	sc->calib_done++;
+	if (forced)
+		sc->calib_forced++;
+	sc->calib_blocked_total += blocked;
+	if (sc->calib_blocked_max < blocked)
+		sc->calib_blocked_max = blocked;
+}
+
+/*
+ * Dynamic initial gain: raise Rx gain when there are many
+ * false alarms, lower it otherwise; the weakest associated
+ * station limits both bounds.
+ */
+static void
+urtwm_dig(struct urtwm_softc *sc)
+{
+	struct ieee80211com *ic = &sc->sc_ic;
+	struct ieee80211_node *ni;
+	uint32_t fa;
+	int i, igi, dig_min, dig_max, rssi, rssi_min;
+	uint8_t cck_pd;
+
+	URTWM_ASSERT_LOCKED(sc);
+
+	/* Counters are used by channel survey during scan. */
+	if (ic->ic_flags & IEEE80211_F_SCAN)
+		return;
+
+	/* Read and reset false alarm counters. */
+	sc->dig_fa_ofdm = MS(urtwm_bb_read(sc, R12A_OFDM_FA_CNT),
+	    R12A_FA_CNT);
+	sc->dig_fa_cck = MS(urtwm_bb_read(sc, R12A_CCK_FA_CNT), R12A_FA_CNT);
+	urtwm_bb_setbits(sc, R12A_OFDM_FA_RST, 0, R12A_OFDM_FA_RST_EN);
+	urtwm_bb_setbits(sc, R12A_OFDM_FA_RST, R12A_OFDM_FA_RST_EN, 0);
+	urtwm_bb_setbits(sc, R12A_CCK_FA_RST, R12A_CCK_FA_RST_EN, 0);
+	urtwm_bb_setbits(sc, R12A_CCK_FA_RST, 0, R12A_CCK_FA_RST_EN);
+	fa = sc->dig_fa_ofdm + sc->dig_fa_cck;
+
+	if (!sc->dig_enable)
+		return;
+
+	/* RSSI in 0 - 100 range; 0 means 'not associated'. */
+	rssi_min = 0;
+	URTWM_NT_LOCK(sc);
+	for (i = 0; i <= URTWM_MACID_MAX(sc); i++) {
+		ni = sc->node_list[i];
+		if (ni == NULL || URTWM_NODE(ni)->last_rssi == 0)
+			continue;
+
+		rssi = MAX(1, MIN(URTWM_NODE(ni)->last_rssi + 100, 100));
+		if (rssi_min == 0 || rssi < rssi_min)
+			rssi_min = rssi;
+	}
+	URTWM_NT_UNLOCK(sc);
+
+	if (rssi_min != 0) {
+		dig_max = MIN(rssi_min + URTWM_DIG_RSSI_OFFSET,
+		    URTWM_DIG_MAX);
+		if (rssi_min < 10)
+			dig_min = URTWM_DIG_MIN;
+		else {
+			dig_min = MAX(MIN(rssi_min - 10,
+			    URTWM_DIG_MAX_OF_MIN), URTWM_DIG_MIN);
+		}
+		dig_max = MAX(dig_max, dig_min);
+	} else {
+		dig_min = URTWM_DIG_MIN;
+		dig_max = URTWM_DIG_MAX;
+	}
+
+	igi = sc->dig_igi;
+	if (fa > URTWM_DIG_FA_TH2)
+		igi += 4;
+	else if (fa > URTWM_DIG_FA_TH1)
+		igi += 2;
+	else if (fa < URTWM_DIG_FA_TH0)
+		igi -= 2;
+	igi = MAX(dig_min, MIN(igi, dig_max));
+
+	URTWM_DPRINTF(sc, URTWM_DEBUG_DIG,
+	    "%s: FA ofdm %u cck %u, rssi_min %d, range %02X-%02X, "
+	    "IGI %02X -> %02X\n", __func__, sc->dig_fa_ofdm, sc->dig_fa_cck,
+	    rssi_min, dig_min, dig_max, sc->dig_igi, igi);
+
+	if (igi != sc->dig_igi) {
+		for (i = 0; i < sc->nrxchains; i++) {
+			urtwm_bb_setbits(sc, R12A_INITIAL_GAIN(i),
+			    R12A_INITIAL_GAIN_IGI_M, igi);
+		}
+		sc->dig_igi = igi;
+	}
+
+	/* CCK packet detection threshold. */
+	if (!IEEE80211_IS_CHAN_2GHZ(ic->ic_curchan))
+		return;
+
+	if (rssi_min > 25)
+		cck_pd = 0xcd;
+	else if (rssi_min > 10 || sc->dig_fa_cck > 1000)
+		cck_pd = 0x83;
+	else
+		cck_pd = 0x40;
+
+	if (cck_pd != sc->dig_cck_pd) {
+		urtwm_write_1(sc, R12A_CCK_PD_TH, cck_pd);
+		sc->dig_cck_pd = cck_pd;
+	}
+}
+
+/* Restore initial gain and CCK packet detection threshold. */
+static void
+urtwm_dig_reset(struct urtwm_softc *sc)
+{
+	int i;
+
+	URTWM_ASSERT_LOCKED(sc);
+
+	if (sc->dig_igi != URTWM_DIG_INIT) {
+		for (i = 0; i < sc->nrxchains; i++) {
+			urtwm_bb_setbits(sc, R12A_INITIAL_GAIN(i),
+			    R12A_INITIAL_GAIN_IGI_M, URTWM_DIG_INIT);
+		}
+		sc->dig_igi = URTWM_DIG_INIT;
+	}
+
+	if (sc->dig_cck_pd != sc->dig_cck_pd_def) {
+		urtwm_write_1(sc, R12A_CCK_PD_TH, sc->dig_cck_pd_def);
+		sc->dig_cck_pd = sc->dig_cck_pd_def;
+	}
+}
+
 static void
 urtwm_calib_cb(struct urtwm_softc *sc, union sec_param *data)
 {
 	/* Do temperature compensation. */
-	urtwm_temp_calib(sc);
+	if (ticks - sc->calib_last_temp >= URTWM_CALIB_PERIOD) {
+		sc->calib_last_temp = ticks;
+		urtwm_temp_calib(sc);
+		urtwm_dig(sc);
+		urtwm_rxagg_update(sc);
+		urtwm_edca_turbo(sc);
+	}
 
-	if (sc->vaps_running > sc->monvaps_running)
-		callout_reset(&sc->sc_calib_to, 2*hz, urtwm_calib_to, sc);
+	urtwm_calib_sched(sc);
+
+	if (sc->vaps_running > sc->monvaps_running) {
+		callout_reset(&sc->sc_calib_to, sc->calib_pending ?
+		    URTWM_CALIB_RETRY : URTWM_CALIB_PERIOD, urtwm_calib_to,
+		    sc);
+	}
 }
 
+/* NB: used to build sc->rssi_cck[] only. */
 static int8_t
-urtwm_r12a_get_rssi_cck(struct urtwm_softc *sc, void *physt)
+urtwm_r12a_cck_pwdb(uint8_t val, int hipwr)
 {
-	struct r12a_rx_phystat *stat = (struct r12a_rx_phystat *)physt;
 	int8_t lna_idx, vga_idx, pwdb;
 
-	lna_idx = (stat->cfosho[0] & 0xe0) >> 5;
-	vga_idx = (stat->cfosho[0] & 0x1f);
+	lna_idx = (val & 0xe0) >> 5;
+	vga_idx = (val & 0x1f);
 	pwdb = 6 - 2 * vga_idx;
 
 	switch (lna_idx) {
@@ -4060,7 +6628,7 @@ urtwm_r12a_get_rssi_cck(struct urtwm_softc *sc, void *physt)
 		break;
 	case 2:
 		pwdb += -6 + 2 * 5;
-		if (sc->sc_flags & URTWM_FLAG_CCK_HIPWR)
+		if (hipwr)
 			pwdb -= 6;
 		break;
 	case 1:
@@ -4077,13 +6645,12 @@ urtwm_r12a_get_rssi_cck(struct urtwm_softc *sc, void *physt)
 }
 
 static int8_t
-urtwm_r21a_get_rssi_cck(struct urtwm_softc *sc, void *physt)
+urtwm_r21a_cck_pwdb(uint8_t val, int hipwr)
 {
-	struct r12a_rx_phystat *stat = (struct r12a_rx_phystat *)physt;
 	int8_t lna_idx, pwdb;
 
-	lna_idx = (stat->cfosho[0] & 0xe0) >> 5;
-	pwdb = -6 - 2*(stat->cfosho[0] & 0x1f);	/* Pout - (2 * VGA_idx) */
+	lna_idx = (val & 0xe0) >> 5;
+	pwdb = -6 - 2*(val & 0x1f);	/* Pout - (2 * VGA_idx) */
 
 	switch (lna_idx) {
 	case 5:
@@ -4106,30 +6673,35 @@ urtwm_r21a_get_rssi_cck(struct urtwm_softc *sc, void *physt)
 	return (pwdb);		/* XXX PWDB -> RSSI conversion? */
 }
 
-static int8_t
-urtwm_get_rssi_ofdm(struct urtwm_softc *sc, void *physt)
+/*
+ * Precompute CCK PWDB for every LNA / VGA index combination
+ * (the whole cfosho[0] byte) and both CCK report formats.
+ */
+static void
+urtwm_rssi_init(struct urtwm_softc *sc)
 {
-	struct r12a_rx_phystat *stat = (struct r12a_rx_phystat *)physt;
-	int i, rssi;
+	int hipwr, val;
 
-	rssi = 0;
-	for (i = 0; i < sc->nrxchains; i++)
-		rssi += (stat->gain_trsw[i] & 0x7f) - 110;
-
-	return (rssi / sc->nrxchains);
+	for (hipwr = 0; hipwr < 2; hipwr++)
+		for (val = 0; val < 256; val++)
+			sc->rssi_cck[hipwr][val] = sc->sc_cck_pwdb(val, hipwr);
 }
 
-static int8_t
+static __inline int8_t
 urtwm_get_rssi(struct urtwm_softc *sc, int rate, void *physt)
 {
-	int8_t rssi;
+	struct r12a_rx_phystat *stat = (struct r12a_rx_phystat *)physt;
 
-	if (URTWM_RATE_IS_CCK(rate))
-		rssi = urtwm_get_rssi_cck(sc, physt);
-	else	/* OFDM/HT. */
-		rssi = urtwm_get_rssi_ofdm(sc, physt);
+	if (URTWM_RATE_IS_CCK(rate)) {
+		return (sc->rssi_cck[!!(sc->sc_flags & URTWM_FLAG_CCK_HIPWR)]
+		    [stat->cfosho[0]]);
+	}
 
-	return (rssi);
+	/* OFDM/HT: average over Rx chains. */
+	if (sc->nrxchains == 1)
+		return ((stat->gain_trsw[0] & 0x7f) - 110);
+	return (((stat->gain_trsw[0] & 0x7f) + (stat->gain_trsw[1] & 0x7f) -
+	    2 * 110) / 2);
 }
 
 static void
@@ -4264,8 +6836,8 @@ urtwm_tx_data(struct urtwm_softc *sc, struct ieee80211_node *ni,
 	struct ieee80211_channel *chan;
 	struct ieee80211_frame *wh;
 	struct r12a_tx_desc *txd;
-	uint8_t macid, rate, ridx, type, tid, qos, qsel;
-	int hasqos, ismcast;
+	uint8_t macid, rate, ridx, type, tid, qos, qsel, fb_lmt;
+	int drvrate, hasqos, ismcast;
 
 	URTWM_ASSERT_LOCKED(sc);
 
@@ -4286,6 +6858,8 @@ urtwm_tx_data(struct urtwm_softc *sc, struct ieee80211_node *ni,
 	chan = (ni->ni_chan != IEEE80211_CHAN_ANYC) ?
 		ni->ni_chan : ic->ic_curchan;
 	tp = &vap->iv_txparms[ieee80211_chan2mode(chan)];
+	fb_lmt = 0x1f;
+	drvrate = 0;
 
 	/* Choose a TX rate index. */
 	if (type == IEEE80211_FC0_TYPE_MGT)
@@ -4301,6 +6875,11 @@ urtwm_tx_data(struct urtwm_softc *sc, struct ieee80211_node *ni,
 			/* XXX pass pktlen */
 			(void) ieee80211_ratectl_rate(ni, NULL, 0);
 			rate = ni->ni_txrate;
+		} else if (URTWM_USE_DRV_RATECTL(sc) &&
+		    (ridx = urtwm_ra_get_rate(sc, ni, &fb_lmt)) !=
+		    URTWM_RIDX_UNKNOWN) {
+			rate = urtwm_ridx2rate(ridx);
+			drvrate = 1;
 		} else {
 			if (ni->ni_flags & IEEE80211_NODE_HT)
 				rate = IEEE80211_RATE_MCS | 0x4; /* MCS4 */
@@ -4345,6 +6924,7 @@ urtwm_tx_data(struct urtwm_softc *sc, struct ieee80211_node *ni,
 
 		struct urtwm_node *un = URTWM_NODE(ni);
 		macid = un->id;
+		un->key_active = ticks;
 
 		if (type == IEEE80211_FC0_TYPE_DATA) {
 			qsel = tid % URTWM_MAX_TID;
@@ -4358,9 +6938,20 @@ urtwm_tx_data(struct urtwm_softc *sc, struct ieee80211_node *ni,
 			} else
 				txd->txdw2 |= htole32(R12A_TXDW2_AGGBK);
 
-			txd->txdw2 |= htole32(R12A_TXDW2_SPE_RPT);
-			if (sc->sc_flags & URTWM_FW_LOADED)
-				sc->sc_tx_n_active++;
+			/*
+			 * Driver rate control matches Tx reports with
+			 * start rates of its own frames (recorded by
+			 * urtwm_txeof() once the frame is handed over).
+			 */
+			if (!URTWM_USE_DRV_RATECTL(sc) || drvrate) {
+				txd->txdw2 |= htole32(R12A_TXDW2_SPE_RPT);
+				if (sc->sc_flags & URTWM_FW_LOADED)
+					sc->sc_tx_n_active++;
+			}
+			if (drvrate && (sc->sc_flags & URTWM_FW_LOADED)) {
+				data->ra_ridx = ridx;
+				data->ra_qsel = qsel;
+			}
 
 			if (ridx >= URTWM_RIDX_MCS(0))
 				urtwm_tx_set_sgi(sc, txd, ni);
@@ -4371,9 +6962,9 @@ urtwm_tx_data(struct urtwm_softc *sc, struct ieee80211_node *ni,
 			} else if (ic->ic_flags & IEEE80211_F_USEPROT)
 				urtwm_tx_protection(sc, txd, ic->ic_protmode);
 
-			/* Data rate fallback limit (max). */
+			/* Data rate fallback limit. */
 			txd->txdw4 |= htole32(SM(R12A_TXDW4_DATARATE_FB_LMT,
-			    0x1f));
+			    fb_lmt));
 		} else	/* IEEE80211_FC0_TYPE_MGT */
 			qsel = R12A_TXDW1_QSEL_MGNT;
 	} else {
@@ -4392,7 +6983,7 @@ urtwm_tx_data(struct urtwm_softc *sc, struct ieee80211_node *ni,
 	urtwm_tx_raid(sc, txd, ni, ismcast);
 
 	/* Force this rate if needed. */
-	if (URTWM_USE_RATECTL(sc) || ismcast ||
+	if (URTWM_USE_RATECTL(sc) || drvrate || ismcast ||
 	    (tp->ucastrate != IEEE80211_FIXED_RATE_NONE) ||
 	    (m->m_flags & M_EAPOL) || type != IEEE80211_FC0_TYPE_DATA)
 		txd->txdw3 |= htole32(R12A_TXDW3_DRVRATE);
@@ -4562,10 +7153,9 @@ static void
 urtwm_tx_start(struct urtwm_softc *sc, struct mbuf *m, uint8_t type,
     struct urtwm_data *data)
 {
-	struct usb_xfer *xfer;
 	struct r12a_tx_desc *txd;
 	uint16_t ac;
-	int xferlen;
+	int qid, xferlen;
 
 	URTWM_ASSERT_LOCKED(sc);
 
@@ -4574,10 +7164,18 @@ urtwm_tx_start(struct urtwm_softc *sc, struct mbuf *m, uint8_t type,
 	switch (type) {
 	case IEEE80211_FC0_TYPE_CTL:
 	case IEEE80211_FC0_TYPE_MGT:
-		xfer = sc->sc_xfer[URTWM_BULK_TX_VO];
+		qid = URTWM_BULK_TX_VO;
 		break;
 	default:
-		xfer = sc->sc_xfer[wme2queue[ac].qid];
+		qid = wme2queue[ac].qid;
+		sc->edca_tx_bytes[ac] += m->m_pkthdr.len;
+
+		if (sc->edca_turbo && ac != WME_AC_BE) {
+			/* Restore EDCA parameters ASAP. */
+			sc->edca_turbo_cnt = 0;
+			urtwm_cmd_sleepable(sc, NULL, 0,
+			    urtwm_edca_turbo_off_cb);
+		}
 		break;
 	}
 
@@ -4588,25 +7186,59 @@ urtwm_tx_start(struct urtwm_softc *sc, struct mbuf *m, uint8_t type,
 	urtwm_tx_checksum(txd);
 
 	xferlen = sizeof(*txd) + m->m_pkthdr.len;
-	m_copydata(m, 0, m->m_pkthdr.len, (caddr_t)&txd[1]);
+
+	/*
+	 * Send the frame straight from the mbuf if the descriptor fits
+	 * into its leading space; the USB stack closes every frame of a
+	 * bulk transfer with a short packet, so chains are still copied.
+	 */
+	if (data->ni != NULL && sc->tx_direct_enable && m->m_next == NULL &&
+	    M_LEADINGSPACE(m) >= sizeof(*txd)) {
+		m->m_data -= sizeof(*txd);
+		m->m_len += sizeof(*txd);
+		m->m_pkthdr.len += sizeof(*txd);
+		memcpy(mtod(m, void *), txd, sizeof(*txd));
+		data->direct = 1;
+		sc->tx_direct++;
+	} else {
+		m_copydata(m, 0, m->m_pkthdr.len, (caddr_t)&txd[1]);
+		sc->tx_copied++;
+	}
 
 	data->buflen = xferlen;
 	if (data->ni != NULL)
 		data->m = m;
 
 	STAILQ_INSERT_TAIL(&sc->sc_tx_pending, data, next);
-	usbd_transfer_start(xfer);
+	urtwm_tx_kick(sc, qid);
+	sc->calib_tx_pkts++;
 }
 
 static void
-urtwm_tx_checksum(struct r12a_tx_desc *txd)
+urtwm_tx_kick(struct urtwm_softc *sc, int qid)
 {
-	uint16_t sum = 0;
 	int i;
 
-	/* NB: checksum calculation takes into account only first 32 bytes. */
-	for (i = 0; i < 32 / 2; i++)
-		sum ^= ((uint16_t *)txd)[i];
+	URTWM_ASSERT_LOCKED(sc);
+
+	/*
+	 * Idle transfers pick up pending frames in order; the USB stack
+	 * completes transfers queued on the same endpoint in order too.
+	 */
+	for (i = 0; i < sc->tx_xfers && !STAILQ_EMPTY(&sc->sc_tx_pending);
+	    i++)
+		usbd_transfer_start(sc->sc_xfer[URTWM_TX_XFER(qid, i)]);
+}
+
+static void
+urtwm_tx_checksum(struct r12a_tx_desc *txd)
+{
+	uint16_t sum = 0;
+	int i;
+
+	/* NB: checksum calculation takes into account only first 32 bytes. */
+	for (i = 0; i < 32 / 2; i++)
+		sum ^= ((uint16_t *)txd)[i];
 	txd->txdsum = sum;	/* NB: already little endian. */
 }
 
@@ -5579,9 +8211,12 @@ urtwm_bb_init(struct urtwm_softc *sc)
 	for (i = 0; i < sc->nrxchains; i++) {
 		urtwm_bb_write(sc, R12A_INITIAL_GAIN(i), 0x22);
 		urtwm_delay(sc, 1);
-		urtwm_bb_write(sc, R12A_INITIAL_GAIN(i), 0x20);
+		urtwm_bb_write(sc, R12A_INITIAL_GAIN(i), URTWM_DIG_INIT);
 		urtwm_delay(sc, 1);
 	}
+	sc->dig_igi = URTWM_DIG_INIT;
+	sc->dig_cck_pd_def = urtwm_read_1(sc, R12A_CCK_PD_TH);
+	sc->dig_cck_pd = sc->dig_cck_pd_def;
 
 	urtwm_crystalcap_write(sc);
 
@@ -5917,10 +8552,97 @@ urtwm_r21a_set_band_5ghz(struct urtwm_softc *sc)
 	    (1 << URTWM_RIDX_OFDM24));
 }
 
+/*
+ * Tx scale (BB swing) values, 0.5 dB per step.
+ */
+static const uint16_t urtwm_tx_scale_tbl[] = {
+	0x081, 0x088, 0x090, 0x099, 0x0a2, 0x0ac, 0x0b6, 0x0c0,
+	0x0cc, 0x0d8, 0x0e5, 0x0f2, 0x101, 0x110, 0x120, 0x131,
+	0x143, 0x156, 0x16a, 0x180, 0x197, 0x1af, 0x1c8, 0x1e3,
+	0x200, 0x21e, 0x23e, 0x261, 0x285, 0x2ab, 0x2d3, 0x2fe,
+	0x32b, 0x35c, 0x38e, 0x3c4, 0x3fe
+};
+#define URTWM_TX_SCALE_0DB	24
+
+static int
+urtwm_get_swing_idx(struct urtwm_softc *sc, struct ieee80211_channel *c,
+    int chain)
+{
+	uint8_t swing;
+
+	if (IEEE80211_IS_CHAN_2GHZ(c))
+		swing = sc->tx_bbswing_2g;
+	else
+		swing = sc->tx_bbswing_5g;
+
+	/* 0 / -3 / -6 / -9 dB. */
+	return (URTWM_TX_SCALE_0DB - ((swing >> chain * 2) & 0x3) * 6);
+}
+
+static void
+urtwm_write_tx_scale(struct urtwm_softc *sc, struct ieee80211_channel *c,
+    int chain)
+{
+	int idx;
+
+	idx = urtwm_get_swing_idx(sc, c, chain) + sc->pwrtrk_swing[chain];
+	if (idx < 0)
+		idx = 0;
+	else if (idx >= nitems(urtwm_tx_scale_tbl))
+		idx = nitems(urtwm_tx_scale_tbl) - 1;
+
+	urtwm_bb_setbits(sc, R12A_TX_SCALE(chain), R12A_TX_SCALE_SWING_M,
+	    urtwm_tx_scale_tbl[idx] << R12A_TX_SCALE_SWING_S);
+}
+
+/*
+ * Distribute thermal correction between BB swing and Tx power index;
+ * returns non-zero if Tx power index adjustment was changed.
+ */
+static int
+urtwm_pwrtrk_split(struct urtwm_softc *sc, struct ieee80211_channel *c)
+{
+	int i, base, delta, idx, pwr, changed;
+
+	/*
+	 * Both BB swing and Tx power index steps are 0.5 dB; limit
+	 * the total boost, so the PA is not driven into saturation
+	 * by the power index when BB swing is exhausted.
+	 */
+	delta = MIN(sc->pwrtrk_delta, URTWM_PWRTRK_UP_MAX);
+
+	changed = 0;
+	for (i = 0; i < URTWM_MAX_RF_PATH; i++) {
+		base = urtwm_get_swing_idx(sc, c, i);
+		idx = base + delta;
+		pwr = 0;
+
+		/*
+		 * Use BB swing first (but do not raise it far above
+		 * the calibrated value - PA may saturate);
+		 * the rest goes to Tx power index.
+		 */
+		if (idx < 0) {
+			pwr = idx;
+			idx = 0;
+		} else if (idx > base + URTWM_PWRTRK_SWING_UP) {
+			pwr = idx - (base + URTWM_PWRTRK_SWING_UP);
+			idx = base + URTWM_PWRTRK_SWING_UP;
+		}
+
+		if (sc->pwrtrk_pwr[i] != pwr)
+			changed = 1;
+
+		sc->pwrtrk_swing[i] = idx - base;
+		sc->pwrtrk_pwr[i] = pwr;
+	}
+
+	return (changed);
+}
+
 static void
 urtwm_set_band(struct urtwm_softc *sc, struct ieee80211_channel *c, int force)
 {
-	uint8_t swing;
 	int i;
 
 	/* Check if band was changed. */
@@ -5928,39 +8650,24 @@ urtwm_set_band(struct urtwm_softc *sc, struct ieee80211_channel *c, int force)
 	    !(urtwm_read_1(sc, R12A_CCK_CHECK) & R12A_CCK_CHECK_5GHZ))
 		return;
 
-	if (IEEE80211_IS_CHAN_2GHZ(c)) {
+	if (IEEE80211_IS_CHAN_2GHZ(c))
 		urtwm_set_band_2ghz(sc);
-		swing = sc->tx_bbswing_2g;
-	} else if (IEEE80211_IS_CHAN_5GHZ(c)) {
+	else if (IEEE80211_IS_CHAN_5GHZ(c))
 		urtwm_set_band_5ghz(sc);
-		swing = sc->tx_bbswing_5g;
-	} else {
+	else {
 		KASSERT(0, ("wrong channel flags %08X\n", c->ic_flags));
 		return;
 	}
 
-	/* XXX PATH_B is set by vendor driver. */
-	for (i = 0; i < 2; i++) {
-		uint16_t val;
-
-		switch ((swing >> i * 2) & 0x3) {
-		case 0:
-			val = 0x200;	/* 0 dB	*/
-			break;
-		case 1:
-			val = 0x16a;	/* -3 dB */
-			break;
-		case 2:
-			val = 0x101;	/* -6 dB */
-			break;
-		case 3:
-			val = 0xb6;	/* -9 dB */
-			break;
-		}
+	/*
+	 * Swing base depends on band; Tx power will be
+	 * reprogrammed by the caller.
+	 */
+	(void) urtwm_pwrtrk_split(sc, c);
 
-		urtwm_bb_setbits(sc, R12A_TX_SCALE(i), R12A_TX_SCALE_SWING_M,
-		    val << R12A_TX_SCALE_SWING_S);
-	}
+	/* XXX PATH_B is set by vendor driver. */
+	for (i = 0; i < 2; i++)
+		urtwm_write_tx_scale(sc, c, i);
 }
 
 static void
@@ -5969,6 +8676,76 @@ urtwm_cam_init(struct urtwm_softc *sc)
 	/* Invalidate all CAM entries. */
 	urtwm_write_4(sc, R92C_CAMCMD,
 	    R92C_CAMCMD_POLLING | R92C_CAMCMD_CLR);
+
+	/* Contents are not cleared; rewrite every entry when used. */
+	memset(sc->cam_shadow, 0, sizeof(sc->cam_shadow));
+	sc->cam_unknown = ~0ULL;
+	sc->cam_staged = 0;
+}
+
+static void
+urtwm_seccfg_update(struct urtwm_softc *sc)
+{
+	uint16_t reg;
+
+	URTWM_ASSERT_LOCKED(sc);
+
+	reg = R92C_SECCFG_TXENC_ENA | R92C_SECCFG_RXDEC_ENA;
+	/* Multicast key search is ambiguous with 2 beaconing vaps. */
+	if (sc->bcn_vaps > 1) {
+		urtwm_gkey_demote(sc);
+		reg |= R92C_SECCFG_MC_SRCH_DIS;
+	}
+
+	urtwm_write_2(sc, R92C_SECCFG, reg);
+}
+
+/*
+ * Move group keys, which were offloaded while multicast key search
+ * was enabled, to software crypto and clear their CAM entries.
+ */
+static void
+urtwm_gkey_demote(struct urtwm_softc *sc)
+{
+	uint32_t words[R92C_CAM_ENTRY_LEN];
+	struct ieee80211vap *vap;
+	struct ieee80211_key *k;
+	int entry, i, kid, n;
+
+	URTWM_ASSERT_LOCKED(sc);
+
+	memset(words, 0, sizeof(words));
+	n = 0;
+	urtwm_rx_block(sc);
+	for (i = 0; i < nitems(sc->vaps); i++) {
+		if (sc->vaps[i] == NULL)
+			continue;
+
+		vap = &sc->vaps[i]->vap;
+		for (kid = 0; kid < IEEE80211_WEP_NKID; kid++) {
+			k = &vap->iv_nw_keys[kid];
+			entry = URTWM_CAM_GKEY_ENTRY(i, kid);
+			if (k->wk_keyix != entry ||
+			    (k->wk_flags & IEEE80211_KEY_SWCRYPT))
+				continue;
+
+			URTWM_DPRINTF(sc, URTWM_DEBUG_KEY,
+			    "%s: vap %d, keyid %d\n", __func__, i, kid);
+			/* NB: serialized as in urtwm_key_demote(). */
+			/* NB: Tx / Rx are serialized by the lock / rx_block. */
+			ieee80211_key_update_begin(vap);
+			k->wk_flags |= IEEE80211_KEY_SWCRYPT;
+			(void) k->wk_cipher->ic_setkey(k);
+			ieee80211_key_update_end(vap);
+
+			urtwm_cam_stage(sc, entry, words);
+			n++;
+		}
+	}
+	urtwm_rx_unblock(sc);
+
+	if (n != 0)
+		urtwm_cam_flush(sc);
 }
 
 static int
@@ -5988,6 +8765,142 @@ urtwm_cam_write(struct urtwm_softc *sc, uint32_t addr, uint32_t data)
 	return (0);
 }
 
+/*
+ * NB: every dword must be loaded into CAMWRITE before CAMCMD is
+ * written; a single request covering both registers would trigger
+ * the write before the data is loaded.
+ */
+static int
+urtwm_cam_write_stream(struct urtwm_softc *sc, const uint16_t addr[],
+    const uint32_t data[], int n)
+{
+	int error, i;
+
+	for (i = 0; i < n; i++) {
+		error = urtwm_cam_write(sc, addr[i], data[i]);
+		if (error != 0)
+			return (error);
+	}
+
+	return (0);
+}
+
+static void
+urtwm_cam_stage(struct urtwm_softc *sc, int entry, const uint32_t words[])
+{
+
+	URTWM_ASSERT_LOCKED(sc);
+	KASSERT(entry >= 0 && entry < R12A_CAM_ENTRY_COUNT,
+	    ("wrong CAM entry %d", entry));
+
+	memcpy(sc->cam_stage[entry], words, sizeof(sc->cam_stage[entry]));
+	sc->cam_staged |= 1ULL << entry;
+}
+
+/*
+ * Write all staged CAM entries; only changed dwords are written
+ * (all of them if the entry state is unknown) and CTL0 (which
+ * validates an entry) always goes last.  Entries that could not be
+ * written stay staged for the next flush.
+ */
+static void
+urtwm_cam_flush(struct urtwm_softc *sc)
+{
+	uint16_t addr[URTWM_CAM_BATCH * (R92C_CAM_ENTRY_LEN + 1)];
+	uint32_t data[URTWM_CAM_BATCH * (R92C_CAM_ENTRY_LEN + 1)];
+	uint32_t words[URTWM_CAM_BATCH][R92C_CAM_ENTRY_LEN];
+	uint32_t *cur, *new;
+	int batch[URTWM_CAM_BATCH];
+	int entry, error, i, j, n, nentries;
+
+	URTWM_ASSERT_LOCKED(sc);
+
+	error = 0;
+	while (sc->cam_staged != 0 && error == 0) {
+		nentries = 0;
+		for (entry = 0; entry < R12A_CAM_ENTRY_COUNT &&
+		    nentries < URTWM_CAM_BATCH; entry++) {
+			if (sc->cam_staged & (1ULL << entry)) {
+				/*
+				 * NB: the lock is dropped during register
+				 * writes; the entry may be staged again.
+				 */
+				memcpy(words[nentries], sc->cam_stage[entry],
+				    sizeof(words[nentries]));
+				sc->cam_staged &= ~(1ULL << entry);
+				batch[nentries++] = entry;
+			}
+		}
+
+		n = 0;
+		/* Invalidate valid entries whose key is going to change. */
+		for (i = 0; i < nentries; i++) {
+			cur = sc->cam_shadow[batch[i]];
+			new = words[i];
+			if (sc->cam_unknown & (1ULL << batch[i])) {
+				addr[n] = R92C_CAM_CTL0(batch[i]);
+				data[n++] = 0;
+				continue;
+			}
+			if (!(cur[0] & R92C_CAM_VALID))
+				continue;
+			for (j = 1; j < R92C_CAM_ENTRY_LEN; j++)
+				if (cur[j] != new[j])
+					break;
+			if (j == R92C_CAM_ENTRY_LEN)
+				continue;
+
+			addr[n] = R92C_CAM_CTL0(batch[i]);
+			data[n++] = 0;
+			cur[0] = 0;
+		}
+		/* Key, MAC address, etc. */
+		for (i = 0; i < nentries; i++) {
+			cur = sc->cam_shadow[batch[i]];
+			new = words[i];
+			for (j = 1; j < R92C_CAM_ENTRY_LEN; j++) {
+				if (cur[j] == new[j] &&
+				    !(sc->cam_unknown & (1ULL << batch[i])))
+					continue;
+				addr[n] = R92C_CAM_CTL0(batch[i]) + j;
+				data[n++] = new[j];
+			}
+		}
+		/* CTL0 last. */
+		for (i = 0; i < nentries; i++) {
+			cur = sc->cam_shadow[batch[i]];
+			new = words[i];
+			if (cur[0] == new[0] &&
+			    !(sc->cam_unknown & (1ULL << batch[i])))
+				continue;
+			addr[n] = R92C_CAM_CTL0(batch[i]);
+			data[n++] = new[0];
+		}
+
+		error = urtwm_cam_write_stream(sc, addr, data, n);
+		for (i = 0; i < nentries; i++) {
+			entry = batch[i];
+			if (error == 0) {
+				memcpy(sc->cam_shadow[entry], words[i],
+				    sizeof(sc->cam_shadow[entry]));
+				sc->cam_unknown &= ~(1ULL << entry);
+			} else {
+				/* Unknown state; rewrite everything later. */
+				sc->cam_unknown |= 1ULL << entry;
+				sc->cam_staged |= 1ULL << entry;
+			}
+		}
+		if (error != 0) {
+			device_printf(sc->sc_dev,
+			    "%s: could not write %d CAM entries, error %d\n",
+			    __func__, nentries, error);
+		}
+
+		URTWM_DPRINTF(sc, URTWM_DEBUG_KEY,
+		    "%s: %d entries, %d dwords\n", __func__, nentries, n);
+	}
+}
+
 static void
 urtwm_rxfilter_update_mgt(struct urtwm_softc *sc)
 {
@@ -6049,9 +8962,63 @@ urtwm_rxfilter_init(struct urtwm_softc *sc)
 	urtwm_write_4(sc, R92C_RCR, rcr);
 
 	/* Update dynamic Rx filter parts. */
+	sc->mon_active = 0;
 	urtwm_rxfilter_update(sc);
 }
 
+/*
+ * Apply user-selected filter when only monitor mode vaps are present
+ * (frames not requested are dropped before they reach USB).
+ */
+static void
+urtwm_rxfilter_mon(struct urtwm_softc *sc)
+{
+	static const uint8_t zero[IEEE80211_ADDR_LEN] = { 0 };
+	uint32_t clr, set;
+
+	URTWM_ASSERT_LOCKED(sc);
+
+	if (!URTWM_MON_ONLY(sc)) {
+		if (sc->mon_active) {
+			/* Restore management frames filter. */
+			urtwm_rxfilter_update_mgt(sc);
+
+			/* Reject all control frames. */
+			urtwm_write_2(sc, R92C_RXFLTMAP1, 0x0000);
+
+			/* Data frames: see urtwm_newstate(). */
+			urtwm_write_2(sc, R92C_RXFLTMAP2,
+			    sc->vaps_running > sc->monvaps_running ?
+			    0xffff : 0x0000);
+
+			urtwm_setbits_4(sc, R92C_RCR,
+			    R92C_RCR_ACRC32 | R92C_RCR_AICV, 0);
+			sc->mon_active = 0;
+		}
+		return;
+	}
+
+	urtwm_write_2(sc, R92C_RXFLTMAP0, sc->mon_fltmap[0]);
+	urtwm_write_2(sc, R92C_RXFLTMAP1, sc->mon_fltmap[1]);
+	urtwm_write_2(sc, R92C_RXFLTMAP2, sc->mon_fltmap[2]);
+
+	clr = set = 0;
+	if (!IEEE80211_ADDR_EQ(sc->mon_bssid, zero)) {
+		/* NB: monitor mode vaps are using port 0. */
+		urtwm_set_bssid(sc, sc->mon_bssid, 0);
+		set |= R92C_RCR_CBSSID_DATA | R92C_RCR_CBSSID_BCN;
+	} else
+		clr |= R92C_RCR_CBSSID_DATA | R92C_RCR_CBSSID_BCN;
+
+	if (sc->mon_rxerr)
+		set |= R92C_RCR_ACRC32 | R92C_RCR_AICV;
+	else
+		clr |= R92C_RCR_ACRC32 | R92C_RCR_AICV;
+
+	urtwm_setbits_4(sc, R92C_RCR, clr, set);
+	sc->mon_active = 1;
+}
+
 static void
 urtwm_edca_init(struct urtwm_softc *sc)
 {
@@ -6073,62 +9040,121 @@ urtwm_edca_init(struct urtwm_softc *sc)
 static void
 urtwm_mrr_init(struct urtwm_softc *sc)
 {
+	/*
+	 * Driver rate control: 2 attempts for the start (best throughput)
+	 * and the next rate, 1 for every further step down to the chain
+	 * floor (see urtwm_ra_get_rate()); NB: counters are cumulative.
+	 */
+	static const uint8_t ra_darfrc[R12A_MRR_SIZE] =
+	    { 2, 4, 5, 6, 7, 8, 9, 10 };
+	int i;
+
+	for (i = 0; i < R12A_MRR_SIZE; i++) {
+		if (URTWM_USE_DRV_RATECTL(sc))
+			urtwm_write_1(sc, R92C_DARFRC + i, ra_darfrc[i]);
+		else {
+			/* Drop rate index by 1 per retry. */
+			urtwm_write_1(sc, R92C_DARFRC + i, i + 1);
+		}
+	}
+}
+
+/*
+ * TXAGC registers for a chain are adjacent, so a run of changed
+ * registers can be written with a single request.
+ */
+static void
+urtwm_write_txagc(struct urtwm_softc *sc, int chain, int first,
+    const uint32_t agc[], int n)
+{
+	uint32_t buf[URTWM_TXAGC_COUNT];
+	usb_error_t error;
 	int i;
 
-	/* Drop rate index by 1 per retry. */
-	for (i = 0; i < R12A_MRR_SIZE; i++)
-		urtwm_write_1(sc, R92C_DARFRC + i, i + 1);
+	CTASSERT(R12A_TXAGC_MCS15_12(0) ==
+	    R12A_TXAGC_CCK11_1(0) + (URTWM_TXAGC_COUNT - 1) * 4);
+
+	for (i = 0; i < n; i++)
+		buf[i] = htole32(agc[first + i]);
+
+	error = urtwm_write_region_1(sc, R12A_TXAGC_CCK11_1(chain) + first * 4,
+	    (uint8_t *)buf, n * 4);
+	if (error != USB_ERR_NORMAL_COMPLETION) {
+		sc->txagc_valid &= ~(1 << chain);
+		return;
+	}
+
+	memcpy(&sc->txagc[chain][first], &agc[first], n * sizeof(agc[0]));
 }
 
 static void
 urtwm_write_txpower(struct urtwm_softc *sc, int chain,
     struct ieee80211_channel *c, uint16_t power[URTWM_RIDX_COUNT])
 {
+	uint32_t agc[URTWM_TXAGC_COUNT];
+	int i, j, valid;
 
-	if (IEEE80211_IS_CHAN_2GHZ(c)) {
-		/* Write per-CCK rate Tx power. */
-		urtwm_bb_write(sc, R12A_TXAGC_CCK11_1(chain),
-		    SM(R12A_TXAGC_CCK1,  power[URTWM_RIDX_CCK1]) |
-		    SM(R12A_TXAGC_CCK2,  power[URTWM_RIDX_CCK2]) |
-		    SM(R12A_TXAGC_CCK55, power[URTWM_RIDX_CCK55]) |
-		    SM(R12A_TXAGC_CCK11, power[URTWM_RIDX_CCK11]));
-	}
+	/* Per-CCK rate Tx power. */
+	agc[0] =
+	    SM(R12A_TXAGC_CCK1,  power[URTWM_RIDX_CCK1]) |
+	    SM(R12A_TXAGC_CCK2,  power[URTWM_RIDX_CCK2]) |
+	    SM(R12A_TXAGC_CCK55, power[URTWM_RIDX_CCK55]) |
+	    SM(R12A_TXAGC_CCK11, power[URTWM_RIDX_CCK11]);
 
-	/* Write per-OFDM rate Tx power. */
-	urtwm_bb_write(sc, R12A_TXAGC_OFDM18_6(chain),
+	/* Per-OFDM rate Tx power. */
+	agc[1] =
 	    SM(R12A_TXAGC_OFDM06, power[URTWM_RIDX_OFDM6]) |
 	    SM(R12A_TXAGC_OFDM09, power[URTWM_RIDX_OFDM9]) |
 	    SM(R12A_TXAGC_OFDM12, power[URTWM_RIDX_OFDM12]) |
-	    SM(R12A_TXAGC_OFDM18, power[URTWM_RIDX_OFDM18]));
-	urtwm_bb_write(sc, R12A_TXAGC_OFDM54_24(chain),
+	    SM(R12A_TXAGC_OFDM18, power[URTWM_RIDX_OFDM18]);
+	agc[2] =
 	    SM(R12A_TXAGC_OFDM24, power[URTWM_RIDX_OFDM24]) |
 	    SM(R12A_TXAGC_OFDM36, power[URTWM_RIDX_OFDM36]) |
 	    SM(R12A_TXAGC_OFDM48, power[URTWM_RIDX_OFDM48]) |
-	    SM(R12A_TXAGC_OFDM54, power[URTWM_RIDX_OFDM54]));
+	    SM(R12A_TXAGC_OFDM54, power[URTWM_RIDX_OFDM54]);
 
-	/* Write per-MCS Tx power. */
-	urtwm_bb_write(sc, R12A_TXAGC_MCS3_0(chain),
+	/* Per-MCS Tx power. */
+	agc[3] =
 	    SM(R12A_TXAGC_MCS0, power[URTWM_RIDX_MCS(0)]) |
 	    SM(R12A_TXAGC_MCS1, power[URTWM_RIDX_MCS(1)]) |
 	    SM(R12A_TXAGC_MCS2, power[URTWM_RIDX_MCS(2)]) |
-	    SM(R12A_TXAGC_MCS3, power[URTWM_RIDX_MCS(3)]));
-	urtwm_bb_write(sc, R12A_TXAGC_MCS7_4(chain),
+	    SM(R12A_TXAGC_MCS3, power[URTWM_RIDX_MCS(3)]);
+	agc[4] =
 	    SM(R12A_TXAGC_MCS4, power[URTWM_RIDX_MCS(4)]) |
 	    SM(R12A_TXAGC_MCS5, power[URTWM_RIDX_MCS(5)]) |
 	    SM(R12A_TXAGC_MCS6, power[URTWM_RIDX_MCS(6)]) |
-	    SM(R12A_TXAGC_MCS7, power[URTWM_RIDX_MCS(7)]));
-	urtwm_bb_write(sc, R12A_TXAGC_MCS11_8(chain),
+	    SM(R12A_TXAGC_MCS7, power[URTWM_RIDX_MCS(7)]);
+	agc[5] =
 	    SM(R12A_TXAGC_MCS8,  power[URTWM_RIDX_MCS(8)]) |
 	    SM(R12A_TXAGC_MCS9,  power[URTWM_RIDX_MCS(9)]) |
 	    SM(R12A_TXAGC_MCS10, power[URTWM_RIDX_MCS(10)]) |
-	    SM(R12A_TXAGC_MCS11, power[URTWM_RIDX_MCS(11)]));
-	urtwm_bb_write(sc, R12A_TXAGC_MCS15_12(chain),
+	    SM(R12A_TXAGC_MCS11, power[URTWM_RIDX_MCS(11)]);
+	agc[6] =
 	    SM(R12A_TXAGC_MCS12, power[URTWM_RIDX_MCS(12)]) |
 	    SM(R12A_TXAGC_MCS13, power[URTWM_RIDX_MCS(13)]) |
 	    SM(R12A_TXAGC_MCS14, power[URTWM_RIDX_MCS(14)]) |
-	    SM(R12A_TXAGC_MCS15, power[URTWM_RIDX_MCS(15)]));
+	    SM(R12A_TXAGC_MCS15, power[URTWM_RIDX_MCS(15)]);
 
 	/* TODO: VHT rates */
+
+	/* Write only changed registers; CCK rates are not used at 5GHz. */
+	valid = !!(sc->txagc_valid & (1 << chain));
+	sc->txagc_valid |= 1 << chain;
+	i = IEEE80211_IS_CHAN_2GHZ(c) ? 0 : 1;
+	while (i < URTWM_TXAGC_COUNT) {
+		if (valid && agc[i] == sc->txagc[chain][i]) {
+			i++;
+			continue;
+		}
+
+		for (j = i + 1; j < URTWM_TXAGC_COUNT; j++) {
+			if (valid && agc[j] == sc->txagc[chain][j])
+				break;
+		}
+
+		urtwm_write_txagc(sc, chain, i, agc, j - i);
+		i = j;
+	}
 }
 
 static int
@@ -6181,17 +9207,13 @@ urtwm_get_power_group(struct urtwm_softc *sc, struct ieee80211_channel *c)
 }
 
 static void
-urtwm_get_txpower(struct urtwm_softc *sc, int chain,
-    struct ieee80211_channel *c, uint16_t power[URTWM_RIDX_COUNT])
+urtwm_get_txpower(struct urtwm_softc *sc, int chain, int is5ghz, int group,
+    int ht40, uint8_t tbl[URTWM_RIDX_COUNT])
 {
-	int i, ridx, group, max_mcs;
+	uint16_t power[URTWM_RIDX_COUNT];
+	int i, ridx, max_mcs;
 
-	/* Determine channel group. */
-	group = urtwm_get_power_group(sc, c);
-	if (group == -1) {	/* shouldn't happen */
-		device_printf(sc->sc_dev, "%s: incorrect channel\n", __func__);
-		return;
-	}
+	memset(power, 0, sizeof(power));
 
 	/* TODO: VHT rates. */
 	max_mcs = URTWM_RIDX_MCS(sc->ntxchains * 8 - 1);
@@ -6199,7 +9221,7 @@ urtwm_get_txpower(struct urtwm_softc *sc, int chain,
 	/* XXX regulatory */
 	/* XXX net80211 regulatory */
 
-	if (IEEE80211_IS_CHAN_2GHZ(c)) {
+	if (!is5ghz) {
 		for (ridx = URTWM_RIDX_CCK1; ridx <= URTWM_RIDX_CCK11; ridx++)
 			power[ridx] = sc->cck_tx_pwr[chain][group];
 		for (ridx = URTWM_RIDX_OFDM6; ridx <= max_mcs; ridx++)
@@ -6215,16 +9237,11 @@ urtwm_get_txpower(struct urtwm_softc *sc, int chain,
 			uint8_t min_mcs;
 			uint8_t pwr_diff;
 
-			if (IEEE80211_IS_CHAN_HT20(c))
-				pwr_diff = sc->bw20_tx_pwr_diff_2g[chain][i];
-			else if (IEEE80211_IS_CHAN_HT40(c))
-				pwr_diff = sc->bw40_tx_pwr_diff_2g[chain][i];
-#ifdef notyet
-			else if (IEEE80211_IS_CHAN_HT80(c)) {
-				/* Vendor driver uses HT40 values here. */
+			/* XXX HT80: vendor driver uses HT40 values here. */
+			if (ht40)
 				pwr_diff = sc->bw40_tx_pwr_diff_2g[chain][i];
-			}
-#endif
+			else
+				pwr_diff = sc->bw20_tx_pwr_diff_2g[chain][i];
 
 			min_mcs = URTWM_RIDX_MCS(i * 8 + 7);
 			for (ridx = min_mcs; ridx <= max_mcs; ridx++)
@@ -6238,16 +9255,11 @@ urtwm_get_txpower(struct urtwm_softc *sc, int chain,
 			uint8_t min_mcs;
 			uint8_t pwr_diff;
 
-			if (IEEE80211_IS_CHAN_HT20(c))
-				pwr_diff = sc->bw20_tx_pwr_diff_5g[chain][i];
-			else if (IEEE80211_IS_CHAN_HT40(c))
+			/* TODO: HT80 (bw80_tx_pwr_diff_5g). */
+			if (ht40)
 				pwr_diff = sc->bw40_tx_pwr_diff_5g[chain][i];
-#ifdef notyet
-			else if (IEEE80211_IS_CHAN_HT80(c)) {
-				/* TODO: calculate base value. */
-				pwr_diff = sc->bw80_tx_pwr_diff_5g[chain][i];
-			}
-#endif
+			else
+				pwr_diff = sc->bw20_tx_pwr_diff_5g[chain][i];
 
 			min_mcs = URTWM_RIDX_MCS(i * 8 + 7);
 			for (ridx = min_mcs; ridx <= max_mcs; ridx++)
@@ -6256,54 +9268,289 @@ urtwm_get_txpower(struct urtwm_softc *sc, int chain,
 	}
 
 	/* Apply max limit. */
-	for (ridx = URTWM_RIDX_CCK1; ridx <= max_mcs; ridx++) {
+	for (ridx = URTWM_RIDX_CCK1; ridx < URTWM_RIDX_COUNT; ridx++) {
 		if (power[ridx] > R92C_MAX_TX_PWR)
 			power[ridx] = R92C_MAX_TX_PWR;
+		tbl[ridx] = power[ridx];
 	}
-
-#ifdef USB_DEBUG
-	if (sc->sc_debug & URTWM_DEBUG_TXPWR) {
-		/* Dump per-rate Tx power values. */
-		printf("Tx power for chain %d:\n", chain);
-		for (ridx = URTWM_RIDX_CCK1; ridx < URTWM_RIDX_COUNT; ridx++)
-			printf("Rate %d = %u\n", ridx, power[ridx]);
-	}
-#endif
 }
 
+/*
+ * Tx power depends on channel group and bandwidth only;
+ * compute it once after ROM parsing.
+ */
 static void
-urtwm_set_txpower(struct urtwm_softc *sc, struct ieee80211_channel *c)
+urtwm_init_txpower(struct urtwm_softc *sc)
 {
-	uint16_t power[URTWM_RIDX_COUNT];
-	int i;
+	int chain, group, ht40;
 
-	for (i = 0; i < sc->ntxchains; i++) {
-		memset(power, 0, sizeof(power));
-		/* Compute per-rate Tx power values. */
-		urtwm_get_txpower(sc, i, c, power);
-		/* Write per-rate Tx power values to hardware. */
-		urtwm_write_txpower(sc, i, c, power);
+	KASSERT(sc->ntxchains <= URTWM_TXPWR_CHAINS,
+	    ("%s: too many Tx chains (%d)\n", __func__, sc->ntxchains));
+
+	for (chain = 0; chain < sc->ntxchains; chain++) {
+		for (ht40 = 0; ht40 < 2; ht40++) {
+			for (group = 0; group < URTWM_MAX_GROUP_2G; group++) {
+				urtwm_get_txpower(sc, chain, 0, group, ht40,
+				    sc->txpwr_tbl[chain][group][ht40]);
+			}
+			for (group = 0; group < URTWM_MAX_GROUP_5G; group++) {
+				urtwm_get_txpower(sc, chain, 1, group, ht40,
+				    sc->txpwr_tbl[chain]
+				    [URTWM_MAX_GROUP_2G + group][ht40]);
+			}
+		}
 	}
 }
 
-static void
-urtwm_set_rx_bssid_all(struct urtwm_softc *sc, int enable)
+/* Rates with Tx power set by urtwm_get_txpower() (bitmap of ridx). */
+static uint32_t
+urtwm_txpower_rates(struct urtwm_softc *sc, struct ieee80211_channel *c)
 {
-	if (enable)
-		urtwm_setbits_4(sc, R92C_RCR, R92C_RCR_CBSSID_BCN, 0);
-	else
-		urtwm_setbits_4(sc, R92C_RCR, 0, R92C_RCR_CBSSID_BCN);
-}
+	uint32_t rates;
+	int ridx, max_mcs;
 
-static void
+	/* TODO: VHT rates. */
+	max_mcs = URTWM_RIDX_MCS(sc->ntxchains * 8 - 1);
+
+	rates = 0;
+	for (ridx = URTWM_RIDX_CCK1; ridx <= max_mcs; ridx++) {
+		/* CCK rates are not used at 5GHz. */
+		if (IEEE80211_IS_CHAN_5GHZ(c) && URTWM_RATE_IS_CCK(ridx))
+			continue;
+		rates |= 1 << ridx;
+	}
+
+	return (rates);
+}
+
+static void
+urtwm_set_txpower(struct urtwm_softc *sc, struct ieee80211_channel *c)
+{
+	uint16_t power[URTWM_RIDX_COUNT];
+	const uint8_t *tbl;
+	uint32_t rates;
+	int i, ridx, group, ht40;
+
+	/* Determine channel group. */
+	group = urtwm_get_power_group(sc, c);
+	if (group == -1) {	/* shouldn't happen */
+		device_printf(sc->sc_dev, "%s: incorrect channel\n", __func__);
+		return;
+	}
+	if (IEEE80211_IS_CHAN_5GHZ(c))
+		group += URTWM_MAX_GROUP_2G;
+	ht40 = !!IEEE80211_IS_CHAN_HT40(c);
+	rates = urtwm_txpower_rates(sc, c);
+
+	for (i = 0; i < sc->ntxchains; i++) {
+		tbl = sc->txpwr_tbl[i][group][ht40];
+		for (ridx = URTWM_RIDX_CCK1; ridx < URTWM_RIDX_COUNT; ridx++) {
+			int pwr = tbl[ridx];
+
+			/* Thermal compensation (skip unused rates). */
+			if (rates & (1 << ridx))
+				pwr += sc->pwrtrk_pwr[i];
+			if (pwr < 0)
+				pwr = 0;
+			else if (pwr > R92C_MAX_TX_PWR)
+				pwr = R92C_MAX_TX_PWR;
+			power[ridx] = pwr;
+		}
+
+#ifdef USB_DEBUG
+		if (sc->sc_debug & URTWM_DEBUG_TXPWR) {
+			/* Dump per-rate Tx power values. */
+			printf("Tx power for chain %d:\n", i);
+			for (ridx = URTWM_RIDX_CCK1; ridx < URTWM_RIDX_COUNT;
+			    ridx++)
+				printf("Rate %d = %u\n", ridx, power[ridx]);
+		}
+#endif
+
+		/* Write per-rate Tx power values to hardware. */
+		urtwm_write_txpower(sc, i, c, power);
+	}
+}
+
+static void
+urtwm_set_rx_bssid_all(struct urtwm_softc *sc, int enable)
+{
+	if (enable)
+		urtwm_setbits_4(sc, R92C_RCR, R92C_RCR_CBSSID_BCN, 0);
+	else
+		urtwm_setbits_4(sc, R92C_RCR, 0, R92C_RCR_CBSSID_BCN);
+}
+
+static int
+urtwm_survey_idx(struct urtwm_softc *sc, struct ieee80211_channel *c)
+{
+	uint8_t chan;
+	int i;
+
+	chan = ieee80211_chan2ieee(&sc->sc_ic, c);
+	if (IEEE80211_IS_CHAN_2GHZ(c)) {
+		for (i = 0; i < nitems(urtwm_chan_2ghz); i++)
+			if (urtwm_chan_2ghz[i] == chan)
+				return (i);
+	} else {
+		for (i = 0; i < nitems(urtwm_chan_5ghz); i++)
+			if (urtwm_chan_5ghz[i] == chan)
+				return (nitems(urtwm_chan_2ghz) + i);
+	}
+
+	return (-1);
+}
+
+/*
+ * Start sampling channel load: reset CCA / false alarm counters.
+ */
+static void
+urtwm_survey_start(struct urtwm_softc *sc, struct ieee80211_channel *c)
+{
+
+	URTWM_ASSERT_LOCKED(sc);
+
+	sc->survey_idx = urtwm_survey_idx(sc, c);
+	if (sc->survey_idx == -1)
+		return;
+
+	urtwm_bb_setbits(sc, R12A_OFDM_FA_RST, 0, R12A_OFDM_FA_RST_EN);
+	urtwm_bb_setbits(sc, R12A_OFDM_FA_RST, R12A_OFDM_FA_RST_EN, 0);
+	urtwm_bb_setbits(sc, R12A_CCK_FA_RST, R12A_CCK_FA_RST_EN, 0);
+	urtwm_bb_setbits(sc, R12A_CCK_FA_RST, 0, R12A_CCK_FA_RST_EN);
+	urtwm_bb_setbits(sc, R12A_CCA_CNT_RST, 0, R12A_CCA_CNT_RST_EN);
+	urtwm_bb_setbits(sc, R12A_CCA_CNT_RST, R12A_CCA_CNT_RST_EN, 0);
+
+	sc->survey_start = sbinuptime();
+}
+
+static void
+urtwm_survey_stop(struct urtwm_softc *sc)
+{
+	struct urtwm_survey *s;
+	uint32_t cca;
+
+	URTWM_ASSERT_LOCKED(sc);
+
+	if (sc->survey_idx == -1)
+		return;
+
+	s = &sc->survey[sc->survey_idx];
+	sc->survey_idx = -1;
+
+	cca = urtwm_bb_read(sc, R12A_CCA_CNT);
+	s->cca_ofdm += MS(cca, R12A_CCA_CNT_OFDM);
+	s->cca_cck += MS(cca, R12A_CCA_CNT_CCK);
+	s->fa_ofdm += MS(urtwm_bb_read(sc, R12A_OFDM_FA_CNT), R12A_FA_CNT);
+	s->fa_cck += MS(urtwm_bb_read(sc, R12A_CCK_FA_CNT), R12A_FA_CNT);
+	s->time += (sbinuptime() - sc->survey_start) / SBT_1US;
+}
+
+/*
+ * Leave BSS channel: wait until already queued frames
+ * (including null data frame with PM bit set, sent by net80211)
+ * are out and pause AC queues.
+ */
+static void
+urtwm_bgscan_leave(struct urtwm_softc *sc)
+{
+	sbintime_t deadline;
+	int drained;
+
+	URTWM_ASSERT_LOCKED(sc);
+
+	/* NB: tick length does not matter; the budget is fixed. */
+	deadline = sbinuptime() + URTWM_BGSCAN_DRAIN * SBT_1MS;
+	drained = 0;
+
+	/* Wait for pending Tx transfers. */
+	while (sbinuptime() < deadline) {
+		if (STAILQ_EMPTY(&sc->sc_tx_active) &&
+		    STAILQ_EMPTY(&sc->sc_tx_pending)) {
+			drained = 1;
+			break;
+		}
+		usb_pause_mtx(&sc->sc_mtx, MAX(msecs_to_ticks(1), 1));
+	}
+
+	/* Wait for AC queues (same bits as in R92C_TXPAUSE). */
+	while (drained) {
+		if ((urtwm_read_1(sc, R12A_TXPKT_EMPTY) & R92C_TX_QUEUE_AC) ==
+		    R92C_TX_QUEUE_AC)
+			break;
+		if (sbinuptime() >= deadline) {
+			drained = 0;
+			break;
+		}
+		urtwm_delay(sc, 1000);
+	}
+	if (!drained)
+		sc->bgscan_drain_timeouts++;
+
+	/* Pause AC Tx queues. */
+	urtwm_setbits_1(sc, R92C_TXPAUSE, 0, R92C_TX_QUEUE_AC);
+
+	sc->sc_flags |= URTWM_BGSCAN_OFFCHAN;
+	sc->bgscan_left = ticks;
+	sc->bgscan_offchan++;
+}
+
+static void
+urtwm_bgscan_return(struct urtwm_softc *sc)
+{
+	u_int ms;
+
+	URTWM_ASSERT_LOCKED(sc);
+
+	/* Dwell time limit is not needed anymore. */
+	callout_stop(&sc->sc_bgscan_to);
+
+	/* Flush all AC queues. */
+	urtwm_setbits_1(sc, R92C_TXPAUSE, R92C_TX_QUEUE_AC, 0);
+
+	sc->sc_flags &= ~URTWM_BGSCAN_OFFCHAN;
+	ms = ticks_to_msecs(ticks - sc->bgscan_left);
+	if (sc->bgscan_offchan_max < ms)
+		sc->bgscan_offchan_max = ms;
+}
+
+/* Dwell time limit expired; move on to the next channel. */
+static void
+urtwm_bgscan_to(void *arg)
+{
+	struct urtwm_softc *sc = arg;
+	struct ieee80211com *ic = &sc->sc_ic;
+	struct ieee80211vap *vap;
+
+	IEEE80211_LOCK(ic);
+	if (ic->ic_flags & IEEE80211_F_SCAN)
+		vap = ic->ic_scan->ss_vap;
+	else
+		vap = NULL;
+	IEEE80211_UNLOCK(ic);
+
+	if (vap != NULL)
+		ieee80211_scan_next(vap);
+}
+
+static void
 urtwm_scan_start(struct ieee80211com *ic)
 {
 	struct urtwm_softc *sc = ic->ic_softc;
+	struct ieee80211vap *vap = ic->ic_scan->ss_vap;
 
 	URTWM_LOCK(sc);
 	/* Receive beacons / probe responses from any BSSID. */
 	if (sc->bcn_vaps == 0)
 		urtwm_set_rx_bssid_all(sc, 1);
+
+	/*
+	 * Background scan: pause AC queues while off-channel.
+	 * Hostap vaps cannot tell their stations to hold traffic.
+	 */
+	if (sc->vaps_running > sc->monvaps_running &&
+	    vap->iv_opmode != IEEE80211_M_HOSTAP)
+		sc->sc_flags |= URTWM_BGSCAN;
 	URTWM_UNLOCK(sc);
 }
 
@@ -6315,6 +9562,17 @@ urtwm_scan_curchan(struct ieee80211_scan_state *ss, unsigned long maxdwell)
 	/* Make link LED blink during scan. */
 	URTWM_LOCK(sc);
 	urtwm_set_led(sc, URTWM_LED_LINK, !sc->ledlink);
+
+	/* Collect channel load statistics while dwelling here. */
+	urtwm_survey_stop(sc);
+	urtwm_survey_start(sc, ss->ss_ic->ic_curchan);
+
+	/* Limit time spent off-channel. */
+	if ((sc->sc_flags & URTWM_BGSCAN_OFFCHAN) && sc->bgscan_dwell != 0) {
+		callout_reset(&sc->sc_bgscan_to,
+		    MAX(msecs_to_ticks(sc->bgscan_dwell), 1),
+		    urtwm_bgscan_to, sc);
+	}
 	URTWM_UNLOCK(sc);
 
 	sc->sc_scan_curchan(ss, maxdwell);
@@ -6326,10 +9584,17 @@ urtwm_scan_end(struct ieee80211com *ic)
 	struct urtwm_softc *sc = ic->ic_softc;
 
 	URTWM_LOCK(sc);
+	urtwm_survey_stop(sc);
+
 	/* Restore limitations. */
 	if (ic->ic_promisc == 0 && sc->bcn_vaps == 0)
 		urtwm_set_rx_bssid_all(sc, 0);
 
+	callout_stop(&sc->sc_bgscan_to);
+	sc->sc_flags &= ~URTWM_BGSCAN;
+	if (sc->sc_flags & URTWM_BGSCAN_OFFCHAN)
+		urtwm_bgscan_return(sc);
+
 	/* Restore LED state. */
 	urtwm_set_led(sc, URTWM_LED_LINK, (sc->vaps_running != 0));
 	URTWM_UNLOCK(sc);
@@ -6366,7 +9631,13 @@ urtwm_set_channel(struct ieee80211com *ic)
 	struct ieee80211_channel *c = ic->ic_curchan;
 
 	URTWM_LOCK(sc);
+	urtwm_survey_stop(sc);
+	if ((sc->sc_flags & (URTWM_BGSCAN | URTWM_BGSCAN_OFFCHAN)) ==
+	    URTWM_BGSCAN && c != ic->ic_bsschan)
+		urtwm_bgscan_leave(sc);
 	urtwm_set_chan(sc, c);
+	if ((sc->sc_flags & URTWM_BGSCAN_OFFCHAN) && c == ic->ic_bsschan)
+		urtwm_bgscan_return(sc);
 	sc->sc_rxtap.wr_chan_freq = htole16(c->ic_freq);
 	sc->sc_rxtap.wr_chan_flags = htole16(c->ic_flags);
 	sc->sc_txtap.wt_chan_freq = htole16(c->ic_freq);
@@ -6374,13 +9645,234 @@ urtwm_set_channel(struct ieee80211com *ic)
 	URTWM_UNLOCK(sc);
 }
 
+static void
+urtwm_edca_write(struct urtwm_softc *sc, int ac, const struct wmeParams *wmep)
+{
+	struct ieee80211com *ic = &sc->sc_ic;
+	uint8_t aifs;
+
+	/* AIFS[AC] = AIFSN[AC] * aSlotTime + aSIFSTime. */
+	aifs = wmep->wmep_aifsn * IEEE80211_GET_SLOTTIME(ic) +
+	    (IEEE80211_IS_CHAN_5GHZ(ic->ic_curchan) ?
+		IEEE80211_DUR_OFDM_SIFS : IEEE80211_DUR_SIFS);
+	urtwm_write_4(sc, wme2queue[ac].reg,
+	    SM(R92C_EDCA_PARAM_TXOP, wmep->wmep_txopLimit) |
+	    SM(R92C_EDCA_PARAM_ECWMIN, wmep->wmep_logcwmin) |
+	    SM(R92C_EDCA_PARAM_ECWMAX, wmep->wmep_logcwmax) |
+	    SM(R92C_EDCA_PARAM_AIFS, aifs));
+}
+
+static void
+urtwm_edca_turbo_set(struct urtwm_softc *sc, int on)
+{
+	struct wmeParams *be = &sc->edca_turbo_be;
+
+	URTWM_ASSERT_LOCKED(sc);
+
+	URTWM_DPRINTF(sc, URTWM_DEBUG_STATE, "%s: EDCA turbo %s\n",
+	    __func__, on ? "on" : "off");
+
+	if (on) {
+		*be = sc->cap_wmeParams[WME_AC_BE];
+		be->wmep_aifsn = MIN(be->wmep_aifsn, URTWM_EDCA_TURBO_AIFSN);
+		be->wmep_logcwmin = MIN(be->wmep_logcwmin,
+		    URTWM_EDCA_TURBO_LOGCWMIN);
+		be->wmep_logcwmax = MIN(be->wmep_logcwmax,
+		    URTWM_EDCA_TURBO_LOGCWMAX);
+		urtwm_edca_write(sc, WME_AC_BE, be);
+		sc->edca_turbo_on++;
+	} else
+		urtwm_edca_write(sc, WME_AC_BE, &sc->cap_wmeParams[WME_AC_BE]);
+
+	sc->edca_turbo = on;
+}
+
+/*
+ * Use aggressive BE parameters while a single (BE) flow
+ * dominates and there is nobody to compete with.
+ */
+static void
+urtwm_edca_turbo(struct urtwm_softc *sc)
+{
+	struct ieee80211com *ic = &sc->sc_ic;
+	uint64_t be, busy, other;
+	uint32_t cca;
+	int ac, contention, elapsed, turbo;
+
+	URTWM_ASSERT_LOCKED(sc);
+
+	elapsed = ticks - sc->edca_window;
+	if (elapsed <= 0)
+		elapsed = 1;
+
+	be = other = 0;
+	for (ac = 0; ac < WME_NUM_AC; ac++) {
+		if (ac == WME_AC_BE) {
+			be += sc->edca_tx_bytes[ac] + sc->edca_rx_bytes[ac];
+		} else {
+			other += sc->edca_tx_bytes[ac] +
+			    sc->edca_rx_bytes[ac];
+		}
+		sc->edca_tx_bytes[ac] = sc->edca_rx_bytes[ac] = 0;
+	}
+	be = be * hz / elapsed;
+	other = other * hz / elapsed;
+	sc->edca_window = ticks;
+
+	/*
+	 * Contention: CCA events not caused by frames received by us
+	 * (other transmitters on the channel) or frequent Tx retries.
+	 * NB: CCA counters are used by channel survey during scan.
+	 */
+	contention = 1;
+	busy = 0;
+	if (!(ic->ic_flags & IEEE80211_F_SCAN)) {
+		cca = urtwm_bb_read(sc, R12A_CCA_CNT);
+		urtwm_bb_setbits(sc, R12A_CCA_CNT_RST, 0,
+		    R12A_CCA_CNT_RST_EN);
+		urtwm_bb_setbits(sc, R12A_CCA_CNT_RST,
+		    R12A_CCA_CNT_RST_EN, 0);
+
+		busy = MS(cca, R12A_CCA_CNT_OFDM) + MS(cca, R12A_CCA_CNT_CCK);
+		busy = (busy > sc->edca_rx_frames) ?
+		    (busy - sc->edca_rx_frames) * hz / elapsed : 0;
+		contention = busy > URTWM_EDCA_TURBO_CCA_MAX ||
+		    sc->edca_tx_retries * 100 >
+		    sc->edca_tx_rpts * URTWM_EDCA_TURBO_RETRY_PCT;
+	}
+	sc->edca_rx_frames = 0;
+	sc->edca_tx_rpts = sc->edca_tx_retries = 0;
+
+	/*
+	 * NB: BE parameters are ours only when there are no station
+	 * vaps; an AP's WME parameters are never overridden.
+	 */
+	turbo = sc->edca_turbo_enable &&
+	    sc->cap_wmeParams[WME_AC_BE].wmep_aifsn != 0 &&
+	    sc->nvaps - sc->bcn_vaps - sc->mon_vaps == 0 &&
+	    sc->vaps_running - sc->monvaps_running == 1 && !contention &&
+	    be >= URTWM_EDCA_TURBO_MIN_RATE &&
+	    other * URTWM_EDCA_TURBO_RATIO <= be;
+	if (!turbo)
+		sc->edca_turbo_cnt = 0;
+	else if (sc->edca_turbo_cnt < URTWM_EDCA_TURBO_HOLD)
+		sc->edca_turbo_cnt++;
+
+	URTWM_DPRINTF(sc, URTWM_DEBUG_STATE,
+	    "%s: BE %ju B/s, other %ju B/s, busy %ju CCA/s, contention %d, "
+	    "cnt %d\n", __func__, (uintmax_t)be, (uintmax_t)other,
+	    (uintmax_t)busy, contention, sc->edca_turbo_cnt);
+
+	turbo = (sc->edca_turbo_cnt == URTWM_EDCA_TURBO_HOLD);
+	if (turbo != sc->edca_turbo)
+		urtwm_edca_turbo_set(sc, turbo);
+}
+
+static void
+urtwm_edca_turbo_off_cb(struct urtwm_softc *sc, union sec_param *data)
+{
+
+	if (sc->edca_turbo)
+		urtwm_edca_turbo_set(sc, 0);
+}
+
+static void
+urtwm_rxagg_thresh(struct urtwm_softc *sc, int level, int *size, int *time)
+{
+
+	switch (level) {
+	case URTWM_RXAGG_LOW:
+		*size = 1;
+		*time = 1;
+		break;
+	case URTWM_RXAGG_HIGH:
+		/* Leave (at least) 1 KB for the frame crossing the threshold. */
+		*size = MAX(sc->ac_usb_dma_size, sc->rx_bufsz / 1024 - 1);
+		*size = MIN(*size, 0xff);
+		*time = MAX(sc->ac_usb_dma_time, URTWM_RXAGG_HIGH_TIME);
+		break;
+	default:
+		*size = sc->ac_usb_dma_size;
+		*time = sc->ac_usb_dma_time;
+		break;
+	}
+}
+
+static void
+urtwm_rxagg_set(struct urtwm_softc *sc, int level)
+{
+	int size, time;
+
+	URTWM_ASSERT_LOCKED(sc);
+
+	urtwm_rxagg_thresh(sc, level, &size, &time);
+
+	URTWM_DPRINTF(sc, URTWM_DEBUG_STATE,
+	    "%s: level %d -> %d (size %d, time %d)\n", __func__,
+	    sc->rxagg_level, level, size, time);
+
+	urtwm_write_2(sc, R92C_RXDMA_AGG_PG_TH, size | (time << 8));
+	if (level != sc->rxagg_level)
+		sc->rxagg_changes++;
+	sc->rxagg_level = level;
+}
+
+/*
+ * Pick USB Rx aggregation thresholds: fewer, larger transfers under
+ * sustained bulk Rx; (almost) none for sparse or VO / VI traffic,
+ * where they would only add latency.
+ */
+static void
+urtwm_rxagg_update(struct urtwm_softc *sc)
+{
+	uint64_t bytes, frames, rt;
+	int elapsed, level;
+
+	URTWM_ASSERT_LOCKED(sc);
+
+	elapsed = ticks - sc->rxagg_window;
+	if (elapsed <= 0)
+		elapsed = 1;
+	frames = sc->rxagg_win_frames * hz / elapsed;
+	bytes = sc->rxagg_win_bytes * hz / elapsed;
+	sc->rxagg_win_frames = sc->rxagg_win_bytes = 0;
+	sc->rxagg_window = ticks;
+
+	/* NB: must run before urtwm_edca_turbo() clears these counters. */
+	rt = sc->edca_tx_bytes[WME_AC_VO] + sc->edca_rx_bytes[WME_AC_VO] +
+	    sc->edca_tx_bytes[WME_AC_VI] + sc->edca_rx_bytes[WME_AC_VI];
+
+	if (!sc->rxagg_enable)
+		level = URTWM_RXAGG_MID;
+	else if (rt != 0 || frames < URTWM_RXAGG_LOW_PPS)
+		level = URTWM_RXAGG_LOW;
+	else if (bytes >= URTWM_RXAGG_HIGH_RATE)
+		level = URTWM_RXAGG_HIGH;
+	else
+		level = URTWM_RXAGG_MID;
+
+	/* Back off immediately; raise only when the load persists. */
+	if (level <= sc->rxagg_level)
+		sc->rxagg_cnt = 0;
+	else if (++sc->rxagg_cnt < URTWM_RXAGG_HOLD)
+		level = sc->rxagg_level;
+	else
+		sc->rxagg_cnt = 0;
+
+	URTWM_DPRINTF(sc, URTWM_DEBUG_STATE,
+	    "%s: %ju frames/s, %ju B/s, VO/VI %ju B, level %d\n", __func__,
+	    (uintmax_t)frames, (uintmax_t)bytes, (uintmax_t)rt, level);
+
+	if (level != sc->rxagg_level)
+		urtwm_rxagg_set(sc, level);
+}
+
 static int
 urtwm_wme_update(struct ieee80211com *ic)
 {
-	struct ieee80211_channel *c = ic->ic_curchan;
 	struct urtwm_softc *sc = ic->ic_softc;
 	struct wmeParams *wmep = sc->cap_wmeParams;
-	uint8_t aifs, acm, slottime;
+	uint8_t acm;
 	int ac;
 
 	/* Prevent possible races. */
@@ -6392,19 +9884,14 @@ urtwm_wme_update(struct ieee80211com *ic)
 	IEEE80211_UNLOCK(ic);
 
 	acm = 0;
-	slottime = IEEE80211_GET_SLOTTIME(ic);
 
 	URTWM_LOCK(sc);
+	/* New parameters will override EDCA turbo ones. */
+	sc->edca_turbo = 0;
+	sc->edca_turbo_cnt = 0;
+
 	for (ac = WME_AC_BE; ac < WME_NUM_AC; ac++) {
-		/* AIFS[AC] = AIFSN[AC] * aSlotTime + aSIFSTime. */
-		aifs = wmep[ac].wmep_aifsn * slottime +
-		    (IEEE80211_IS_CHAN_5GHZ(c) ?
-			IEEE80211_DUR_OFDM_SIFS : IEEE80211_DUR_SIFS);
-		urtwm_write_4(sc, wme2queue[ac].reg,
-		    SM(R92C_EDCA_PARAM_TXOP, wmep[ac].wmep_txopLimit) |
-		    SM(R92C_EDCA_PARAM_ECWMIN, wmep[ac].wmep_logcwmin) |
-		    SM(R92C_EDCA_PARAM_ECWMAX, wmep[ac].wmep_logcwmax) |
-		    SM(R92C_EDCA_PARAM_AIFS, aifs));
+		urtwm_edca_write(sc, ac, &wmep[ac]);
 		if (ac != WME_AC_BE)
 			acm |= wmep[ac].wmep_acm << ac;
 	}
@@ -6442,12 +9929,17 @@ static void
 urtwm_update_aifs(struct urtwm_softc *sc, uint8_t slottime)
 {
 	struct ieee80211_channel *c = sc->sc_ic.ic_curchan;
-	const struct wmeParams *wmep = sc->cap_wmeParams;
+	const struct wmeParams *wmep;
 	uint8_t aifs, ac;
 
 	for (ac = WME_AC_BE; ac < WME_NUM_AC; ac++) {
+		if (ac == WME_AC_BE && sc->edca_turbo)
+			wmep = &sc->edca_turbo_be;
+		else
+			wmep = &sc->cap_wmeParams[ac];
+
 		/* AIFS[AC] = AIFSN[AC] * aSlotTime + aSIFSTime. */
-		aifs = wmep[ac].wmep_aifsn * slottime +
+		aifs = wmep->wmep_aifsn * slottime +
 		    (IEEE80211_IS_CHAN_5GHZ(c) ?
 			IEEE80211_DUR_OFDM_SIFS : IEEE80211_DUR_SIFS);
 		urtwm_write_1(sc, wme2queue[ac].reg, aifs);
@@ -6537,6 +10029,9 @@ urtwm_set_promisc(struct urtwm_softc *sc)
 		urtwm_setbits_4(sc, R92C_RCR, mask1, mask2);
 	else
 		urtwm_setbits_4(sc, R92C_RCR, mask2, mask1);
+
+	/* Monitor mode filter (overrides BSSID checks). */
+	urtwm_rxfilter_mon(sc);
 }
 
 static void
@@ -6615,18 +10110,27 @@ urtwm_newassoc(struct ieee80211_node *ni, int isnew)
 	struct urtwm_node *un = URTWM_NODE(ni);
 	uint8_t id;
 
-	if (!isnew)
-		return;
-
-	URTWM_NT_LOCK(sc);
-	for (id = 0; id <= URTWM_MACID_MAX(sc); id++) {
-		if (id != URTWM_MACID_BC && sc->node_list[id] == NULL) {
-			un->id = id;
-			sc->node_list[id] = ni;
-			break;
+	if (isnew) {
+		URTWM_NT_LOCK(sc);
+		for (id = 0; id <= URTWM_MACID_MAX(sc); id++) {
+			if (id != URTWM_MACID_BC &&
+			    sc->node_list[id] == NULL) {
+				un->id = id;
+				sc->node_list[id] = ni;
+				break;
+			}
 		}
+		URTWM_NT_UNLOCK(sc);
 	}
-	URTWM_NT_UNLOCK(sc);
+
+	/* (Re)initialize driver rate control with the negotiated rates. */
+	if (un->id != URTWM_MACID_UNDEFINED) {
+		urtwm_cmd_sleepable(sc, &un->id, sizeof(un->id),
+		    urtwm_ra_node_init_cb);
+	}
+
+	if (!isnew)
+		return;
 
 	if (id > URTWM_MACID_MAX(sc)) {
 		device_printf(sc->sc_dev, "%s: node table is full\n",
@@ -6661,7 +10165,8 @@ urtwm_node_free(struct ieee80211_node *ni)
 }
 
 static void
-urtwm_fix_spur(struct urtwm_softc *sc, struct ieee80211_channel *c)
+urtwm_fix_spur(struct urtwm_softc *sc, struct ieee80211_channel *c,
+    struct urtwm_chan_regs *r)
 {
 	uint16_t chan = IEEE80211_CHAN2IEEE(c);
 
@@ -6670,43 +10175,67 @@ urtwm_fix_spur(struct urtwm_softc *sc, struct ieee80211_channel *c)
 
 	if (sc->chip & URTWM_CHIP_12A_C_CUT) {
 		if (IEEE80211_IS_CHAN_HT40(c) && chan == 11) {
-			urtwm_bb_setbits(sc, R12A_RFMOD, 0, 0xc00);
-			urtwm_bb_setbits(sc, R12A_ADC_BUF_CLK, 0, 0x40000000);
+			r->rfmod |= 0xc00;
+			r->adc_buf_clk |= 0x40000000;
 		} else {
-			urtwm_bb_setbits(sc, R12A_RFMOD, 0x400, 0x800);
+			r->rfmod = (r->rfmod & ~0x400) | 0x800;
 
 			if (!IEEE80211_IS_CHAN_HT40(c) &&	/* 20 MHz */
 			    (chan == 13 || chan == 14)) {
-				urtwm_bb_setbits(sc, R12A_RFMOD, 0, 0x300);
-				urtwm_bb_setbits(sc, R12A_ADC_BUF_CLK,
-				    0, 0x40000000);
+				r->rfmod |= 0x300;
+				r->adc_buf_clk |= 0x40000000;
 			} else {	/* !80 Mhz */
-				urtwm_bb_setbits(sc, R12A_RFMOD, 0x100, 0x200);
-				urtwm_bb_setbits(sc, R12A_ADC_BUF_CLK,
-				    0x40000000, 0);
+				r->rfmod = (r->rfmod & ~0x100) | 0x200;
+				r->adc_buf_clk &= ~0x40000000;
 			}
 		}
 	} else {
 		/* Set ADC clock to 160M to resolve 2480 MHz spur. */
 		if (!IEEE80211_IS_CHAN_HT40(c) &&	/* 20 MHz */
 		    (chan == 13 || chan == 14))
-			urtwm_bb_setbits(sc, R12A_RFMOD, 0, 0x300);
+			r->rfmod |= 0x300;
 		else if (IEEE80211_IS_CHAN_2GHZ(c))
-			urtwm_bb_setbits(sc, R12A_RFMOD, 0x100, 0x200);
+			r->rfmod = (r->rfmod & ~0x100) | 0x200;
 	}
 }
 
+/*
+ * Read initial values of all registers that may be changed
+ * on channel switch; done once after initialization.
+ */
 static void
-urtwm_set_chan(struct urtwm_softc *sc, struct ieee80211_channel *c)
+urtwm_chan_regs_read(struct urtwm_softc *sc, struct urtwm_chan_regs *r)
+{
+	int i;
+
+	for (i = 0; i < nitems(r->chnlbw); i++)
+		r->chnlbw[i] = urtwm_rf_read(sc, i, R92C_RF_CHNLBW);
+
+	r->fc_area = urtwm_bb_read(sc, R12A_FC_AREA);
+	r->rfmod = urtwm_bb_read(sc, R12A_RFMOD);
+	r->adc_buf_clk = urtwm_bb_read(sc, R12A_ADC_BUF_CLK);
+	r->cca_on_sec = urtwm_bb_read(sc, R12A_CCA_ON_SEC);
+	r->l1_peak_th = urtwm_bb_read(sc, R12A_L1_PEAK_TH);
+	r->cck0_system = urtwm_bb_read(sc, R92C_CCK0_SYSTEM);
+	r->trxptcl_ctl = urtwm_read_2(sc, R12A_WMAC_TRXPTCL_CTL);
+	r->data_sec = urtwm_read_1(sc, R12A_DATA_SEC);
+	r->reg837 = urtwm_read_1(sc, 0x837);
+	r->band_5ghz = !!(urtwm_read_1(sc, R12A_CCK_CHECK) &
+	    R12A_CCK_CHECK_5GHZ);
+}
+
+/*
+ * Compute register values for the given channel; no I/O is done here.
+ */
+static void
+urtwm_chan_compile(struct urtwm_softc *sc, struct ieee80211_channel *c,
+    struct urtwm_chan_regs *r)
 {
-	struct ieee80211com *ic = &sc->sc_ic;
 	uint32_t val;
 	uint16_t chan;
 	int i;
 
-	urtwm_set_band(sc, c, 0);
-
-	chan = ieee80211_chan2ieee(ic, c);	/* XXX center freq! */
+	chan = ieee80211_chan2ieee(&sc->sc_ic, c);	/* XXX center freq! */
 	KASSERT(chan != 0 && chan != IEEE80211_CHAN_ANY,
 	    ("invalid channel %x\n", chan));
 
@@ -6721,30 +10250,26 @@ urtwm_set_chan(struct urtwm_softc *sc, struct ieee80211_channel *c)
 	else
 		val = 0x12d40000;
 
-	urtwm_bb_setbits(sc, R12A_FC_AREA, 0x1ffe0000, val);
-
-	for (i = 0; i < sc->nrxchains; i++) {
-		if (36 <= chan && chan <= 64)
-			val = 0x10100;
-		else if (100 <= chan && chan <= 140)
-			val = 0x30100;
-		else if (140 < chan)
-			val = 0x50100;
-		else
-			val = 0x00000;
-
-		urtwm_rf_setbits(sc, i, R92C_RF_CHNLBW, 0x70300, val);
+	r->fc_area = (r->fc_area & ~0x1ffe0000) | val;
 
-		if (URTWM_CHIP_IS_12A(sc))
-			urtwm_fix_spur(sc, c);
+	if (36 <= chan && chan <= 64)
+		val = 0x10100;
+	else if (100 <= chan && chan <= 140)
+		val = 0x30100;
+	else if (140 < chan)
+		val = 0x50100;
+	else
+		val = 0x00000;
 
-		KASSERT(chan <= 0xff, ("%s: chan %d\n", __func__, chan));
-		urtwm_rf_setbits(sc, i, R92C_RF_CHNLBW, 0xff, chan);
+	KASSERT(chan <= 0xff, ("%s: chan %d\n", __func__, chan));
+	for (i = 0; i < sc->nrxchains; i++) {
+		r->chnlbw[i] = (r->chnlbw[i] & ~0x70300) | val;
+		r->chnlbw[i] = (r->chnlbw[i] & ~0xff) | chan;
 	}
 
 #ifdef notyet
 	if (IEEE80211_IS_CHAN_HT80(c)) {	/* 80 MHz */
-		urtwm_setbits_2(sc, R12A_WMAC_TRXPTCL_CTL, 0x80, 0x100);
+		r->trxptcl_ctl = (r->trxptcl_ctl & ~0x80) | 0x100;
 
 		/* TODO */
 
@@ -6759,61 +10284,162 @@ urtwm_set_chan(struct urtwm_softc *sc, struct ieee80211_channel *c)
 		else
 			ext_chan = R12A_DATA_SEC_PRIM_UP_20;
 
-		urtwm_setbits_2(sc, R12A_WMAC_TRXPTCL_CTL, 0x100, 0x80);
-		urtwm_write_1(sc, R12A_DATA_SEC, ext_chan);
+		r->trxptcl_ctl = (r->trxptcl_ctl & ~0x100) | 0x80;
+		r->data_sec = ext_chan;
 
-		urtwm_bb_setbits(sc, R12A_RFMOD, 0x003003c3, 0x00300201);
-		urtwm_bb_setbits(sc, R12A_ADC_BUF_CLK, 0x40000000, 0);
+		r->rfmod = (r->rfmod & ~0x003003c3) | 0x00300201;
+		r->adc_buf_clk &= ~0x40000000;
 
 		/* discard high 4 bits */
-		val = urtwm_bb_read(sc, R12A_RFMOD);
-		val = RW(val, R12A_RFMOD_EXT_CHAN, ext_chan);
-		urtwm_bb_write(sc, R12A_RFMOD, val);
+		r->rfmod = RW(r->rfmod, R12A_RFMOD_EXT_CHAN, ext_chan);
+		r->cca_on_sec = RW(r->cca_on_sec, R12A_CCA_ON_SEC_EXT_CHAN,
+		    ext_chan);
 
-		val = urtwm_bb_read(sc, R12A_CCA_ON_SEC);
-		val = RW(val, R12A_CCA_ON_SEC_EXT_CHAN, ext_chan);
-		urtwm_bb_write(sc, R12A_CCA_ON_SEC, val);
-
-		if (urtwm_read_1(sc, 0x837) & 0x04)
+		if (r->reg837 & 0x04)
 			val = 0x01800000;
 		else if (sc->nrxchains == 2 && sc->ntxchains == 2)
 			val = 0x01c00000;
 		else
 			val = 0x02000000;
 
-		urtwm_bb_setbits(sc, R12A_L1_PEAK_TH, 0x03c00000, val);
+		r->l1_peak_th = (r->l1_peak_th & ~0x03c00000) | val;
 
 		if (IEEE80211_IS_CHAN_HT40U(c))
-			urtwm_bb_setbits(sc, R92C_CCK0_SYSTEM, 0x10, 0);
+			r->cck0_system &= ~0x10;
 		else
-			urtwm_bb_setbits(sc, R92C_CCK0_SYSTEM, 0, 0x10);
+			r->cck0_system |= 0x10;
 
 		val = 0x400;
 	} else {	/* 20 MHz */
-		urtwm_setbits_2(sc, R12A_WMAC_TRXPTCL_CTL, 0x180, 0);
-		urtwm_write_1(sc, R12A_DATA_SEC, R12A_DATA_SEC_NO_EXT);
+		r->trxptcl_ctl &= ~0x180;
+		r->data_sec = R12A_DATA_SEC_NO_EXT;
 
-		urtwm_bb_setbits(sc, R12A_RFMOD, 0x003003c3, 0x00300200);
-		urtwm_bb_setbits(sc, R12A_ADC_BUF_CLK, 0x40000000, 0);
+		r->rfmod = (r->rfmod & ~0x003003c3) | 0x00300200;
+		r->adc_buf_clk &= ~0x40000000;
 
 		if (sc->nrxchains == 2 && sc->ntxchains == 2)
 			val = 0x01c00000;
 		else
 			val = 0x02000000;
 
-		urtwm_bb_setbits(sc, R12A_L1_PEAK_TH, 0x03c00000, val);
+		r->l1_peak_th = (r->l1_peak_th & ~0x03c00000) | val;
 
 		val = 0xc00;
 	}
 
-	if (URTWM_CHIP_IS_12A(sc))
-		urtwm_fix_spur(sc, c);
+	urtwm_fix_spur(sc, c, r);
 
-	for (i = 0; i < 2; i++)
-		urtwm_rf_setbits(sc, i, R92C_RF_CHNLBW, 0xc00, val);
+	for (i = 0; i < nitems(r->chnlbw); i++)
+		r->chnlbw[i] = (r->chnlbw[i] & ~0xc00) | val;
+}
+
+/*
+ * Write registers that differ from the last written values.
+ */
+static int
+urtwm_chan_replay(struct urtwm_softc *sc, const struct urtwm_chan_regs *r)
+{
+	struct urtwm_chan_regs *cur = &sc->chan_regs;
+	int i, error;
+
+	error = 0;
+	if (r->fc_area != cur->fc_area)
+		error |= urtwm_bb_write(sc, R12A_FC_AREA, r->fc_area);
+	if (r->trxptcl_ctl != cur->trxptcl_ctl) {
+		error |= urtwm_write_2(sc, R12A_WMAC_TRXPTCL_CTL,
+		    r->trxptcl_ctl);
+	}
+	if (r->data_sec != cur->data_sec)
+		error |= urtwm_write_1(sc, R12A_DATA_SEC, r->data_sec);
+	if (r->rfmod != cur->rfmod)
+		error |= urtwm_bb_write(sc, R12A_RFMOD, r->rfmod);
+	if (r->adc_buf_clk != cur->adc_buf_clk)
+		error |= urtwm_bb_write(sc, R12A_ADC_BUF_CLK, r->adc_buf_clk);
+	if (r->cca_on_sec != cur->cca_on_sec)
+		error |= urtwm_bb_write(sc, R12A_CCA_ON_SEC, r->cca_on_sec);
+	if (r->l1_peak_th != cur->l1_peak_th)
+		error |= urtwm_bb_write(sc, R12A_L1_PEAK_TH, r->l1_peak_th);
+	if (r->cck0_system != cur->cck0_system)
+		error |= urtwm_bb_write(sc, R92C_CCK0_SYSTEM, r->cck0_system);
+
+	for (i = 0; i < nitems(r->chnlbw); i++) {
+		if (r->chnlbw[i] != cur->chnlbw[i]) {
+			error |= urtwm_rf_write(sc, i, R92C_RF_CHNLBW,
+			    r->chnlbw[i]);
+		}
+	}
+
+	if (error != 0) {
+		/* Re-read everything next time. */
+		sc->chan_regs_valid = 0;
+		return (EIO);
+	}
+
+	*cur = *r;
+
+	return (0);
+}
+
+/*
+ * Program band, channel and Tx power; IQ compensation and
+ * channel switch statistics are left to the caller.
+ */
+static int
+urtwm_chan_program(struct urtwm_softc *sc, struct ieee80211_channel *c)
+{
+	struct urtwm_chan_regs regs;
+	int error, is_5ghz;
+
+	URTWM_ASSERT_LOCKED(sc);
+
+	if (!sc->chan_regs_valid) {
+		urtwm_chan_regs_read(sc, &sc->chan_regs);
+		sc->chan_regs_valid = 1;
+	}
+
+	/*
+	 * NB: band switch still does read-modify-write of the band
+	 * specific registers; switches within a band do no reads.
+	 */
+	is_5ghz = !!IEEE80211_IS_CHAN_5GHZ(c);
+	if (sc->chan_regs.band_5ghz != is_5ghz) {
+		urtwm_set_band(sc, c, 1);
+		sc->chan_regs.band_5ghz = is_5ghz;
+	}
+
+	regs = sc->chan_regs;
+	urtwm_chan_compile(sc, c, &regs);
+	error = urtwm_chan_replay(sc, &regs);
 
 	/* Set Tx power for this new channel. */
 	urtwm_set_txpower(sc, c);
+
+	return (error);
+}
+
+static void
+urtwm_set_chan(struct urtwm_softc *sc, struct ieee80211_channel *c)
+{
+	sbintime_t start;
+	uint64_t usec;
+	u_int xfers;
+
+	URTWM_ASSERT_LOCKED(sc);
+
+	xfers = sc->ctrl_xfers;
+	start = sbinuptime();
+
+	(void) urtwm_chan_program(sc, c);
+
+	/* Restore IQ compensation for this channel (if known). */
+	urtwm_iqk_restore(sc, c);
+
+	usec = (sbinuptime() - start) / SBT_1US;
+	sc->chansw_count++;
+	sc->chansw_usec += usec;
+	if (sc->chansw_usec_max < usec)
+		sc->chansw_usec_max = usec;
+	sc->chansw_xfers += sc->ctrl_xfers - xfers;
 }
 
 static void
@@ -6827,11 +10453,348 @@ urtwm_antsel_init(struct urtwm_softc *sc)
 	sc->sc_ant = MS(reg, R12A_FPGA0_RFIFACEOE0_ANT);
 }
 
+/*
+ * IQ calibration results depend on band, channel, bandwidth
+ * and temperature.
+ */
+static uint16_t
+urtwm_iqk_key(struct urtwm_softc *sc, struct ieee80211_channel *c)
+{
+	uint16_t key;
+	int group;
+
+	group = urtwm_get_power_group(sc, c);
+	if (group == -1)
+		group = 0;
+
+	key = SM(URTWM_IQK_KEY_GROUP, group) |
+	    SM(URTWM_IQK_KEY_TEMP, sc->thcal_temp / URTWM_CALIB_THRESHOLD);
+	if (IEEE80211_IS_CHAN_5GHZ(c))
+		key |= URTWM_IQK_KEY_5GHZ;
+	if (IEEE80211_IS_CHAN_HT40(c))
+		key |= URTWM_IQK_KEY_HT40;
+#ifdef IEEE80211_IS_CHAN_VHT80
+	if (IEEE80211_IS_CHAN_VHT80(c))
+		key |= URTWM_IQK_KEY_VHT80;
+#endif
+
+	return (key);
+}
+
+static void
+urtwm_iqk_read(struct urtwm_softc *sc, struct urtwm_iqk_result *res)
+{
+	uint32_t reg;
+	int i;
+
+	urtwm_bb_setbits(sc, R12A_TXAGC_TABLE_SELECT, 0,
+	    R12A_TXAGC_TABLE_SELECT_PAGE_C1);
+	for (i = 0; i < sc->ntxchains; i++) {
+		res->tx_x[i] = MS(urtwm_bb_read(sc, R12A_TXIQC_X(i)),
+		    R12A_TXIQC_VAL);
+		res->tx_y[i] = MS(urtwm_bb_read(sc, R12A_TXIQC_Y(i)),
+		    R12A_TXIQC_VAL);
+	}
+	urtwm_bb_setbits(sc, R12A_TXAGC_TABLE_SELECT,
+	    R12A_TXAGC_TABLE_SELECT_PAGE_C1, 0);
+
+	for (i = 0; i < sc->ntxchains; i++) {
+		reg = urtwm_bb_read(sc, R12A_RXIQC(i));
+		res->rx_x[i] = MS(reg, R12A_RXIQC_X) << 1;
+		res->rx_y[i] = MS(reg, R12A_RXIQC_Y) << 1;
+	}
+}
+
+static void
+urtwm_iqk_write(struct urtwm_softc *sc, const struct urtwm_iqk_result *res)
+{
+	int i;
+
+	/* Tx compensation registers are on page C1. */
+	urtwm_bb_setbits(sc, R12A_TXAGC_TABLE_SELECT, 0,
+	    R12A_TXAGC_TABLE_SELECT_PAGE_C1);
+	for (i = 0; i < sc->ntxchains; i++) {
+		urtwm_bb_setbits(sc, R12A_TXIQC_CTRL0(i), 0,
+		    R12A_TXIQC_CTRL0_EN);
+		urtwm_bb_setbits(sc, R12A_TXIQC_CTRL1(i), 0,
+		    R12A_TXIQC_CTRL1_EN);
+		urtwm_bb_setbits(sc, R12A_TXIQC_CTRL2(i), 0,
+		    R12A_TXIQC_CTRL2_EN);
+		urtwm_bb_setbits(sc, R12A_TXIQC_Y(i), R12A_TXIQC_VAL_M,
+		    SM(R12A_TXIQC_VAL, res->tx_y[i]));
+		urtwm_bb_setbits(sc, R12A_TXIQC_X(i), R12A_TXIQC_VAL_M,
+		    SM(R12A_TXIQC_VAL, res->tx_x[i]));
+	}
+	urtwm_bb_setbits(sc, R12A_TXAGC_TABLE_SELECT,
+	    R12A_TXAGC_TABLE_SELECT_PAGE_C1, 0);
+
+	for (i = 0; i < sc->ntxchains; i++) {
+		urtwm_bb_setbits(sc, R12A_RXIQC(i),
+		    R12A_RXIQC_X_M | R12A_RXIQC_Y_M,
+		    SM(R12A_RXIQC_X, res->rx_x[i] >> 1) |
+		    SM(R12A_RXIQC_Y, res->rx_y[i] >> 1));
+	}
+}
+
+/* Save calibration results for the given channel. */
+static void
+urtwm_iqk_store(struct urtwm_softc *sc, struct ieee80211_channel *c,
+    const struct urtwm_iqk_result *res)
+{
+	struct urtwm_iqk_cache *entry, *victim;
+	uint16_t key;
+	int i;
+
+	URTWM_ASSERT_LOCKED(sc);
+
+	key = urtwm_iqk_key(sc, c);
+	victim = &sc->iqk_cache[0];
+	for (i = 0; i < nitems(sc->iqk_cache); i++) {
+		entry = &sc->iqk_cache[i];
+		if (!entry->valid || entry->key == key) {
+			victim = entry;
+			break;
+		}
+		if (ticks - entry->used > ticks - victim->used)
+			victim = entry;
+	}
+
+	victim->key = key;
+	victim->valid = 1;
+	victim->used = ticks;
+	victim->res = *res;
+
+	URTWM_DPRINTF(sc, URTWM_DEBUG_CALIB, "%s: key %04X, X %03X, Y %03X\n",
+	    __func__, key, res->tx_x[0], res->tx_y[0]);
+}
+
+static void
+urtwm_iqk_restore(struct urtwm_softc *sc, struct ieee80211_channel *c)
+{
+	struct ieee80211com *ic = &sc->sc_ic;
+	struct urtwm_iqk_cache *entry;
+	uint16_t key;
+	int i;
+
+	URTWM_ASSERT_LOCKED(sc);
+
+	key = urtwm_iqk_key(sc, c);
+	for (i = 0; i < nitems(sc->iqk_cache); i++) {
+		entry = &sc->iqk_cache[i];
+		if (entry->valid && entry->key == key) {
+			entry->used = ticks;
+			sc->iqk_hits++;
+			urtwm_iqk_write(sc, &entry->res);
+			return;
+		}
+	}
+
+	sc->iqk_misses++;
+
+	/* Calibrate the new (operating) channel when possible. */
+	if (sc->vaps_running > sc->monvaps_running &&
+	    !(ic->ic_flags & IEEE80211_F_SCAN))
+		urtwm_calib_request(sc, URTWM_CALIB_IQK);
+}
+
+static void
+urtwm_iqk_save_cb(struct urtwm_softc *sc, union sec_param *data)
+{
+	struct urtwm_iqk_result res;
+	struct ieee80211_channel *c = data->chan;
+
+	/* Registers were reprogrammed by a channel switch; drop results. */
+	if (c == NULL || urtwm_iqk_key(sc, c) !=
+	    urtwm_iqk_key(sc, sc->sc_ic.ic_curchan)) {
+		URTWM_DPRINTF(sc, URTWM_DEBUG_CALIB,
+		    "%s: channel changed, results dropped\n", __func__);
+		return;
+	}
+
+	memset(&res, 0, sizeof(res));
+	urtwm_iqk_read(sc, &res);
+	urtwm_iqk_store(sc, c, &res);
+}
+
+/* One-shot Tx or Rx IQK for the given chain; page C1 must be selected. */
+static int
+urtwm_iqk_run(struct urtwm_softc *sc, int chain, int rx, uint16_t *x,
+    uint16_t *y)
+{
+	uint32_t rpt;
+	int ntries;
+
+	urtwm_bb_write(sc, R12A_IQK_TONE(chain),
+	    rx ? R12A_IQK_TONE_RX : R12A_IQK_TONE_TX);
+	urtwm_bb_write(sc, R12A_IQK_PI(chain), R12A_IQK_PI_INIT);
+	urtwm_bb_write(sc, R12A_IQK_RPT_SEL(chain), R12A_IQK_RPT_SEL_INIT);
+
+	urtwm_bb_write(sc, R12A_IQK_TRIGGER, R12A_IQK_TRIGGER_START);
+	urtwm_bb_write(sc, R12A_IQK_TRIGGER, R12A_IQK_TRIGGER_STOP);
+
+	for (ntries = 0; ntries < 20; ntries++) {
+		urtwm_delay(sc, 1000);
+		rpt = urtwm_bb_read(sc, R12A_IQK_RPT(chain));
+		if (rpt & R12A_IQK_RPT_DONE)
+			break;
+	}
+	if (ntries == 20) {
+		URTWM_DPRINTF(sc, URTWM_DEBUG_CALIB,
+		    "%s: chain %d, %s IQK timeout\n", __func__, chain,
+		    rx ? "Rx" : "Tx");
+		return (ETIMEDOUT);
+	}
+	if (rpt & (rx ? R12A_IQK_RPT_RX_FAIL : R12A_IQK_RPT_TX_FAIL))
+		return (EIO);
+
+	urtwm_bb_write(sc, R12A_IQK_RPT_SEL(chain),
+	    rx ? R12A_IQK_RPT_SEL_RX_X : R12A_IQK_RPT_SEL_TX_X);
+	*x = MS(urtwm_bb_read(sc, R12A_IQK_RPT(chain)), R12A_IQK_RPT_VAL);
+	urtwm_bb_write(sc, R12A_IQK_RPT_SEL(chain),
+	    rx ? R12A_IQK_RPT_SEL_RX_Y : R12A_IQK_RPT_SEL_TX_Y);
+	*y = MS(urtwm_bb_read(sc, R12A_IQK_RPT(chain)), R12A_IQK_RPT_VAL);
+
+	/* X is around 0x200 (1.0); anything else is garbage. */
+	if (*x < 0x100 || *x > 0x300)
+		return (EIO);
+
+	return (0);
+}
+
+static int
+urtwm_iqk_chain(struct urtwm_softc *sc, int chain,
+    struct urtwm_iqk_result *res)
+{
+	int error, i, ntries;
+
+	/* Tx IQK. */
+	for (i = 0; i < nitems(rtl8812au_iqk_rf_regs); i++) {
+		urtwm_rf_write(sc, chain, rtl8812au_iqk_rf_regs[i],
+		    rtl8812au_iqk_rf_tx[i]);
+	}
+	urtwm_bb_write(sc, R12A_IQK_TXIQC, R12A_IQK_TXIQC_INIT);
+	urtwm_bb_write(sc, R12A_IQK_RXIQC, R12A_IQK_RXIQC_INIT);
+
+	error = EIO;
+	for (ntries = 0; ntries < URTWM_IQK_RETRY && error != 0; ntries++) {
+		error = urtwm_iqk_run(sc, chain, 0, &res->tx_x[chain],
+		    &res->tx_y[chain]);
+	}
+	if (error != 0)
+		goto end;
+
+	/* Rx IQK (with Tx IQ imbalance compensated). */
+	for (i = 0; i < nitems(rtl8812au_iqk_rf_regs); i++) {
+		urtwm_rf_write(sc, chain, rtl8812au_iqk_rf_regs[i],
+		    rtl8812au_iqk_rf_rx[i]);
+	}
+	urtwm_bb_write(sc, R12A_IQK_TXIQC,
+	    SM(R12A_IQK_TXIQC_X, res->tx_x[chain]) |
+	    SM(R12A_IQK_TXIQC_Y, res->tx_y[chain]));
+
+	error = EIO;
+	for (ntries = 0; ntries < URTWM_IQK_RETRY && error != 0; ntries++) {
+		error = urtwm_iqk_run(sc, chain, 1, &res->rx_x[chain],
+		    &res->rx_y[chain]);
+	}
+
+end:
+	/* Leave IQK mode. */
+	urtwm_rf_write(sc, chain, R12A_RF_LUT_WE, 0);
+
+	return (error);
+}
+
 static void
 urtwm_iq_calib_sw(struct urtwm_softc *sc)
 {
-	/* TODO */
-	URTWM_DPRINTF(sc, URTWM_DEBUG_CALIB, "%s: SW IQ calibration: TODO\n",
+	static const uint16_t bb_regs[] = {
+		R12A_TXAGC_TABLE_SELECT, R12A_OFDMCCK_EN, R12A_DAC_RSTB,
+		R12A_DPD_CTRL, R12A_IQK_TXIQC, R12A_IQK_RXIQC, R12A_IQK_AGC
+	};
+	static const uint16_t afe_regs[] = {
+		R12A_RX_WAIT_CCA(0), R12A_AFE_POWER_1(0), R12A_AFE_POWER_2(0),
+		R12A_AFE_CLK_CTRL(0), R12A_RFE_PINMUX(0), R12A_RFE_INV(0),
+		R12A_IQK_RPT_SEL(0)
+	};
+	/* NB: restored in reverse order (R12A_RF_LUT_WE is the last). */
+	static const uint8_t rf_regs[] = {
+		R12A_RF_LUT_WE, R12A_RF_LUT_ADDR, R12A_RF_LUT_DATA0,
+		R12A_RF_LUT_DATA1, R92C_RF_AC, R12A_RF_IQK_CTRL1,
+		R12A_RF_IQK_CTRL2
+	};
+	uint32_t bb_save[nitems(bb_regs)];
+	uint32_t afe_save[URTWM_MAX_RF_PATH][nitems(afe_regs)];
+	uint32_t rf_save[URTWM_MAX_RF_PATH][nitems(rf_regs)];
+	struct urtwm_iqk_result res;
+	uint8_t txpause;
+	int chain, error, i, j;
+
+	URTWM_DPRINTF(sc, URTWM_DEBUG_CALIB, "%s: IQ calibration started\n",
+	    __func__);
+
+	/* Save registers. */
+	txpause = urtwm_read_1(sc, R92C_TXPAUSE);
+	for (i = 0; i < nitems(bb_regs); i++)
+		bb_save[i] = urtwm_bb_read(sc, bb_regs[i]);
+	for (i = 0; i < sc->ntxchains; i++) {
+		for (j = 0; j < nitems(afe_regs); j++) {
+			afe_save[i][j] = urtwm_bb_read(sc,
+			    afe_regs[j] + i * 0x200);
+		}
+		for (j = 0; j < nitems(rf_regs); j++)
+			rf_save[i][j] = urtwm_rf_read(sc, i, rf_regs[j]);
+	}
+
+	/* Block Tx, turn off CCK / OFDM blocks and power on AFE. */
+	urtwm_write_1(sc, R92C_TXPAUSE, R92C_TX_QUEUE_ALL);
+	urtwm_bb_setbits(sc, R12A_OFDMCCK_EN,
+	    R12A_OFDMCCK_EN_CCK | R12A_OFDMCCK_EN_OFDM, 0);
+	for (i = 0; i < sc->ntxchains; i++) {
+		urtwm_bb_write(sc, R12A_AFE_POWER_1(i), R12A_AFE_POWER_ON);
+		urtwm_bb_write(sc, R12A_AFE_POWER_2(i), R12A_AFE_POWER_ON);
+		urtwm_bb_write(sc, R12A_AFE_CLK_CTRL(i),
+		    R12A_AFE_CLK_CTRL_IQK);
+		urtwm_bb_setbits(sc, R12A_RFE_PINMUX(i), 0x0f, 0x07);
+	}
+	urtwm_bb_write(sc, R12A_DAC_RSTB, R12A_DAC_RSTB_IQK);
+	urtwm_bb_write(sc, R12A_DPD_CTRL, R12A_DPD_CTRL_IQK);
+	urtwm_bb_write(sc, R12A_IQK_AGC, R12A_IQK_AGC_INIT);
+	urtwm_bb_setbits(sc, R12A_TXAGC_TABLE_SELECT, 0,
+	    R12A_TXAGC_TABLE_SELECT_PAGE_C1);
+
+	memset(&res, 0, sizeof(res));
+	error = 0;
+	for (chain = 0; chain < sc->ntxchains; chain++) {
+		error = urtwm_iqk_chain(sc, chain, &res);
+		if (error != 0)
+			break;
+	}
+
+	/* Restore registers. */
+	for (i = 0; i < sc->ntxchains; i++) {
+		for (j = nitems(rf_regs) - 1; j >= 0; j--)
+			urtwm_rf_write(sc, i, rf_regs[j], rf_save[i][j]);
+		for (j = 0; j < nitems(afe_regs); j++) {
+			urtwm_bb_write(sc, afe_regs[j] + i * 0x200,
+			    afe_save[i][j]);
+		}
+	}
+	for (i = nitems(bb_regs) - 1; i >= 0; i--)
+		urtwm_bb_write(sc, bb_regs[i], bb_save[i]);
+	urtwm_write_1(sc, R92C_TXPAUSE, txpause);
+
+	if (error != 0) {
+		URTWM_DPRINTF(sc, URTWM_DEBUG_CALIB,
+		    "%s: IQ calibration failed (chain %d, error %d)\n",
+		    __func__, chain, error);
+		return;
+	}
+
+	urtwm_iqk_write(sc, &res);
+	urtwm_iqk_store(sc, sc->sc_ic.ic_curchan, &res);
+
+	URTWM_DPRINTF(sc, URTWM_DEBUG_CALIB, "%s: IQ calibration finished\n",
 	    __func__);
 }
 
@@ -6884,6 +10847,7 @@ urtwm_iq_calib_fw(struct urtwm_softc *sc)
 		return;
 	}
 
+	sc->iqk_chan = c;
 	sc->sc_flags |= URTWM_IQK_RUNNING;
 }
 #endif
@@ -6953,10 +10917,69 @@ urtwm_lc_calib(struct urtwm_softc *sc)
 	    __func__);
 }
 
+/* Queue LC / IQ calibration for urtwm_calib_sched(). */
+static void
+urtwm_calib_request(struct urtwm_softc *sc, uint8_t what)
+{
+
+	URTWM_ASSERT_LOCKED(sc);
+
+	if (sc->calib_pending == 0 && what != 0) {
+		sc->calib_since = ticks;
+		sc->calib_deferred++;
+	}
+	sc->calib_pending |= what;
+}
+
+static void
+urtwm_pwrtrk(struct urtwm_softc *sc, uint8_t temp)
+{
+	struct ieee80211_channel *c = sc->sc_ic.ic_curchan;
+	int i, delta, steps;
+
+	URTWM_ASSERT_LOCKED(sc);
+
+	steps = 0;
+	if (sc->pwrtrk_enable && sc->thermal_meter != 0xff) {
+		delta = abs(temp - sc->thermal_meter);
+		if (delta > URTWM_PWRTRK_DELTA_MAX)
+			delta = URTWM_PWRTRK_DELTA_MAX;
+
+		/* ~1.5 (2 GHz) / 2 (5 GHz) thermal units per 0.5 dB. */
+		if (IEEE80211_IS_CHAN_2GHZ(c))
+			steps = (delta * 2 + 1) / 3;
+		else
+			steps = (delta + 1) / 2;
+
+		/*
+		 * Output power drops when PA is heated: raise it when
+		 * hotter than at calibration time, lower when colder.
+		 */
+		if (temp < sc->thermal_meter)
+			steps = -steps;
+	}
+
+	if (steps == sc->pwrtrk_delta)
+		return;
+
+	URTWM_DPRINTF(sc, URTWM_DEBUG_TEMP | URTWM_DEBUG_TXPWR,
+	    "%s: temperature %u (efuse %u), correction %d -> %d\n",
+	    __func__, temp, sc->thermal_meter, sc->pwrtrk_delta, steps);
+
+	sc->pwrtrk_delta = steps;
+	sc->pwrtrk_updates++;
+
+	if (urtwm_pwrtrk_split(sc, c) != 0)
+		urtwm_set_txpower(sc, c);
+	/* XXX PATH_B is set by vendor driver. */
+	for (i = 0; i < 2; i++)
+		urtwm_write_tx_scale(sc, c, i);
+}
+
 static void
 urtwm_temp_calib(struct urtwm_softc *sc)
 {
-	uint8_t temp;
+	uint8_t what, temp;
 
 	URTWM_ASSERT_LOCKED(sc);
 
@@ -6982,14 +11005,18 @@ urtwm_temp_calib(struct urtwm_softc *sc)
 	    "temperature: previous %u, current %u\n",
 	    sc->thcal_temp, temp);
 
+	/* Track Tx power. */
+	urtwm_pwrtrk(sc, temp);
+
 	/*
 	 * Redo LC/IQ calibration if temperature changed significantly since
-	 * last calibration.
+	 * last calibration; it will be done by urtwm_calib_sched().
 	 */
+	what = 0;
 	if (sc->thcal_temp == 0xff) {
 		/* efuse value is absent; do LCK at initial status. */
 		if (!URTWM_CHIP_IS_21A(sc))
-			urtwm_lc_calib(sc);
+			what |= URTWM_CALIB_LCK;
 
 		sc->thcal_temp = temp;
 	} else if (abs(temp - sc->thcal_temp) > URTWM_CALIB_THRESHOLD) {
@@ -6998,12 +11025,14 @@ urtwm_temp_calib(struct urtwm_softc *sc)
 		    __func__, sc->thcal_temp, temp);
 
 		if (!URTWM_CHIP_IS_21A(sc))
-			urtwm_lc_calib(sc);
-		urtwm_iq_calib(sc);
+			what |= URTWM_CALIB_LCK;
+		what |= URTWM_CALIB_IQK;
 
 		/* Record temperature of last calibration. */
 		sc->thcal_temp = temp;
 	}
+
+	urtwm_calib_request(sc, what);
 }
 
 static int
@@ -7019,6 +11048,21 @@ urtwm_init(struct urtwm_softc *sc)
 	}
 	sc->sc_flags |= URTWM_STARTED;
 
+	/* Apply new transfer parameters (if any). */
+	if (sc->sc_flags & URTWM_XFER_RECONF) {
+		sc->sc_flags &= ~URTWM_XFER_RECONF;
+		URTWM_UNLOCK(sc);
+		usbd_transfer_unsetup(sc->sc_xfer, URTWM_N_XFER_MAX);
+		error = urtwm_setup_xfers(sc);
+		URTWM_LOCK(sc);
+		if (error != 0) {
+			sc->sc_flags &= ~URTWM_STARTED;
+			sc->sc_flags |= URTWM_XFER_RECONF;
+			URTWM_UNLOCK(sc);
+			return (error);
+		}
+	}
+
 	/* Allocate Tx/Rx buffers. */
 	error = urtwm_alloc_rx_list(sc);
 	if (error != 0)
@@ -7127,8 +11171,7 @@ urtwm_init(struct urtwm_softc *sc)
 		urtwm_write_1(sc, R12A_DWBCN1_CTRL, sc->tx_agg_desc_num << 1);
 
 	/* Rx aggregation (USB). */
-	urtwm_write_2(sc, R92C_RXDMA_AGG_PG_TH,
-	    sc->ac_usb_dma_size | (sc->ac_usb_dma_time << 8));
+	urtwm_rxagg_set(sc, URTWM_RXAGG_MID);
 	urtwm_setbits_1(sc, R92C_TRXDMA_CTRL, 0,
 	    R92C_TRXDMA_CTRL_RXDMA_AGG_EN);
 
@@ -7208,15 +11251,16 @@ urtwm_init(struct urtwm_softc *sc)
 	urtwm_rf_init(sc);
 
 	/* Initialize wireless band. */
+	sc->pwrtrk_delta = 0;
+	sc->txagc_valid = 0;
+	sc->chan_regs_valid = 0;
 	urtwm_set_band(sc, ic->ic_curchan, 1);
 
 	/* Clear per-station keys table. */
 	urtwm_cam_init(sc);
 
 	/* Enable decryption / encryption. */
-	urtwm_write_2(sc, R92C_SECCFG,
-	    R92C_SECCFG_TXENC_ENA | R92C_SECCFG_RXDEC_ENA |
-	    R92C_SECCFG_MC_SRCH_DIS);
+	urtwm_seccfg_update(sc);
 
 	/* Initialize antenna selection. */
 	urtwm_antsel_init(sc);
@@ -7268,8 +11312,11 @@ urtwm_stop(struct urtwm_softc *sc)
 
 	sc->sc_flags &= ~(URTWM_STARTED | URTWM_RUNNING | URTWM_FW_LOADED);
 	sc->sc_flags &= ~(URTWM_TEMP_MEASURED | URTWM_IQK_RUNNING);
+	sc->sc_flags &= ~(URTWM_BGSCAN | URTWM_BGSCAN_OFFCHAN);
+	sc->survey_idx = -1;
 	sc->fwver = 0;
 	sc->thcal_temp = 0;
+	sc->calib_pending = 0;
 	sc->cur_bcnq_id = URTWM_VAP_ID_INVALID;
 
 #ifdef D4054
@@ -7278,6 +11325,8 @@ urtwm_stop(struct urtwm_softc *sc)
 
 	urtwm_abort_xfers(sc);
 	urtwm_drain_mbufq(sc);
+	urtwm_ra_txq_reset(sc);
+	urtwm_rxq_drain(sc);
 	urtwm_free_tx_list(sc);
 	urtwm_free_rx_list(sc);
 	urtwm_power_off(sc);
@@ -7292,8 +11341,14 @@ urtwm_abort_xfers(struct urtwm_softc *sc)
 	URTWM_ASSERT_LOCKED(sc);
 
 	/* abort any pending transfers */
-	for (i = 0; i < URTWM_N_TRANSFER; i++)
+	for (i = 0; i < URTWM_N_XFER_MAX; i++) {
+		if (sc->sc_xfer[i] == NULL)
+			continue;
 		usbd_transfer_stop(sc->sc_xfer[i]);
+		/* Buffers are released by urtwm_free_tx_list(). */
+		if (i != URTWM_BULK_RX)
+			usbd_xfer_set_priv(sc->sc_xfer[i], NULL);
+	}
 }
 
 static int
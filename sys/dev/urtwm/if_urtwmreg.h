@@ -715,10 +715,22 @@
 #define R12A_HSSI_PARAM2		0x8b0
 #define R12A_ADC_BUF_CLK		0x8c4
 #define R12A_ANTSEL_SW			0x900
+#define R12A_DAC_RSTB			0x90c
 #define R12A_SINGLETONE_CONT_TX		0x914
+#define R12A_IQK_TXIQC			0x978
+#define R12A_IQK_RXIQC			0x97c
+#define R12A_IQK_TRIGGER		0x980
+#define R12A_IQK_AGC			0x984
+#define R12A_OFDM_FA_RST		0x9a4
 #define R92C_CCK0_SYSTEM		0xa00
 #define R12A_CCK_RX_PATH		0xa04
+#define R12A_CCK_PD_TH			0xa0a
+#define R12A_CCK_FA_RST			0xa2c
+#define R12A_CCK_FA_CNT			0xa5c
+#define R12A_DPD_CTRL			0xb00
+#define R12A_CCA_CNT_RST		0xb58
 #define R12A_HSSI_PARAM1(chain)		(0xc00 + (chain) * 0x200)
+#define R12A_RXIQC(chain)		(0xc10 + (chain) * 0x200)
 #define R12A_TX_SCALE(chain)		(0xc1c + (chain) * 0x200)
 #define R12A_TXAGC_CCK11_1(chain)	(0xc20 + (chain) * 0x200)
 #define R12A_TXAGC_OFDM18_6(chain)	(0xc24 + (chain) * 0x200)
@@ -733,14 +745,27 @@
 #define R12A_TXAGC_NSS2IX5_2IX2(chain)	(0xc48 + (chain) * 0x200)
 #define R12A_TXAGC_NSS2IX9_2IX6(chain)	(0xc4c + (chain) * 0x200)
 #define R12A_INITIAL_GAIN(chain)	(0xc50 + (chain) * 0x200)
+#define R12A_RX_WAIT_CCA(chain)		(0xc5c + (chain) * 0x200)
 #define R12A_AFE_POWER_1(chain)		(0xc60 + (chain) * 0x200)
 #define R12A_AFE_POWER_2(chain)		(0xc64 + (chain) * 0x200)
+#define R12A_AFE_CLK_CTRL(chain)	(0xc68 + (chain) * 0x200)
 #define R92C_OFDM0_AGCCORE1(chain)	(0xc50 + (chain) * 8)
+#define R12A_IQK_TONE(chain)		(0xc88 + (chain) * 0x200)
+#define R12A_IQK_PI(chain)		(0xc8c + (chain) * 0x200)
 #define R12A_LSSI_PARAM(chain)		(0xc90 + (chain) * 0x200)
+#define R12A_TXIQC_CTRL0(chain)		(0xc90 + (chain) * 0x200) /* page C1 */
 #define R12A_RFE_PINMUX(chain)		(0xcb0 + (chain) * 0x200)
 #define R12A_RFE_INV(chain)		(0xcb4 + (chain) * 0x200)
+#define R12A_IQK_RPT_SEL(chain)		(0xcb8 + (chain) * 0x200)
+#define R12A_TXIQC_CTRL1(chain)		(0xcc4 + (chain) * 0x200) /* page C1 */
+#define R12A_TXIQC_CTRL2(chain)		(0xcc8 + (chain) * 0x200) /* page C1 */
+#define R12A_TXIQC_Y(chain)		(0xccc + (chain) * 0x200) /* page C1 */
+#define R12A_TXIQC_X(chain)		(0xcd4 + (chain) * 0x200) /* page C1 */
+#define R12A_IQK_RPT(chain)		(0xd00 + (chain) * 0x40)
 #define R12A_HSPI_READBACK(chain)	(0xd04 + (chain) * 0x40)
 #define R12A_LSSI_READBACK(chain)	(0xd08 + (chain) * 0x40)
+#define R12A_CCA_CNT			0xf08
+#define R12A_OFDM_FA_CNT		0xf48
 
 /* Bits for R12A_CCK_RPT_FORMAT. */
 #define R12A_CCK_RPT_FORMAT_HIPWR	0x00010000
@@ -749,6 +774,31 @@
 #define R12A_OFDMCCK_EN_CCK	0x10000000
 #define R12A_OFDMCCK_EN_OFDM	0x20000000
 
+/* Bits for R12A_OFDM_FA_RST. */
+#define R12A_OFDM_FA_RST_EN		0x00020000
+
+/* Bits for R12A_CCK_FA_RST. */
+#define R12A_CCK_FA_RST_EN		0x00008000
+
+/* Bits for R12A_OFDM_FA_CNT / R12A_CCK_FA_CNT. */
+#define R12A_FA_CNT_M			0x0000ffff
+#define R12A_FA_CNT_S			0
+
+/* Bits for R12A_CCA_CNT_RST. */
+#define R12A_CCA_CNT_RST_EN		0x00000001
+
+/* Bits for R12A_CCA_CNT. */
+#define R12A_CCA_CNT_CCK_M		0x0000ffff
+#define R12A_CCA_CNT_CCK_S		0
+#define R12A_CCA_CNT_OFDM_M		0xffff0000
+#define R12A_CCA_CNT_OFDM_S		16
+
+/* Bits for R12A_INITIAL_GAIN(i). */
+#define R12A_INITIAL_GAIN_IGI_M		0x0000007f
+
+/* Bits for R12A_TXAGC_TABLE_SELECT. */
+#define R12A_TXAGC_TABLE_SELECT_PAGE_C1	0x80000000
+
 /* Bits for R12A_CCA_ON_SEC. */
 #define R12A_CCA_ON_SEC_EXT_CHAN_M	0xf0000000
 #define R12A_CCA_ON_SEC_EXT_CHAN_S	28
@@ -771,6 +821,70 @@
 /* Bits for R12A_HSSI_PARAM1(i). */
 #define R12A_HSSI_PARAM1_PI		0x00000004
 
+/* Bits for R12A_RXIQC(i). */
+#define R12A_RXIQC_X_M			0x000003ff
+#define R12A_RXIQC_X_S			0
+#define R12A_RXIQC_Y_M			0x03ff0000
+#define R12A_RXIQC_Y_S			16
+
+/* Bits for R12A_TXIQC_CTRL0(i). */
+#define R12A_TXIQC_CTRL0_EN		0x00000080
+
+/* Bits for R12A_TXIQC_CTRL1(i). */
+#define R12A_TXIQC_CTRL1_EN		0x20040000
+
+/* Bits for R12A_TXIQC_CTRL2(i). */
+#define R12A_TXIQC_CTRL2_EN		0x20000000
+
+/* Bits for R12A_TXIQC_X(i) / R12A_TXIQC_Y(i). */
+#define R12A_TXIQC_VAL_M		0x000007ff
+#define R12A_TXIQC_VAL_S		0
+
+/* Bits for R12A_IQK_TXIQC. */
+#define R12A_IQK_TXIQC_Y_M		0x000007ff
+#define R12A_IQK_TXIQC_Y_S		0
+#define R12A_IQK_TXIQC_X_M		0x03ff8000
+#define R12A_IQK_TXIQC_X_S		15
+
+/* Values for R12A_IQK_RPT_SEL(i). */
+#define R12A_IQK_RPT_SEL_INIT		0x00100000
+#define R12A_IQK_RPT_SEL_TX_X		0x02000000
+#define R12A_IQK_RPT_SEL_TX_Y		0x04000000
+#define R12A_IQK_RPT_SEL_RX_X		0x06000000
+#define R12A_IQK_RPT_SEL_RX_Y		0x08000000
+
+/* Bits for R12A_IQK_RPT(i). */
+#define R12A_IQK_RPT_DONE		0x00000400
+#define R12A_IQK_RPT_RX_FAIL		0x00000800
+#define R12A_IQK_RPT_TX_FAIL		0x00001000
+#define R12A_IQK_RPT_VAL_M		0x07ff0000
+#define R12A_IQK_RPT_VAL_S		16
+
+/*
+ * IQ calibration settings; taken from the vendor driver
+ * (_IQK_Tx_8812A() / _IQK_ConfigureMAC_8812A() in halphyrf_8812a.c).
+ */
+/* Values for R12A_IQK_TONE(i). */
+#define R12A_IQK_TONE_TX		0x821403f1
+#define R12A_IQK_TONE_RX		0x821603e0
+/* Values for R12A_IQK_PI(i). */
+#define R12A_IQK_PI_INIT		0x68163e96
+/* Values for R12A_IQK_TRIGGER. */
+#define R12A_IQK_TRIGGER_START		0xfa000000
+#define R12A_IQK_TRIGGER_STOP		0xf8000000
+/* Initial values for R12A_IQK_TXIQC / R12A_IQK_RXIQC. */
+#define R12A_IQK_TXIQC_INIT		0x29002000
+#define R12A_IQK_RXIQC_INIT		0xa9002000
+/* Values for R12A_IQK_AGC. */
+#define R12A_IQK_AGC_INIT		0x00462910
+/* Values for R12A_AFE_POWER_1(i) / R12A_AFE_POWER_2(i). */
+#define R12A_AFE_POWER_ON		0x77777777
+/* Values for R12A_AFE_CLK_CTRL(i). */
+#define R12A_AFE_CLK_CTRL_IQK		0x19791979
+/* Values for R12A_DAC_RSTB / R12A_DPD_CTRL. */
+#define R12A_DAC_RSTB_IQK		0x00008000
+#define R12A_DPD_CTRL_IQK		0x03000100
+
 /* Bits for R12A_TX_SCALE(i). */
 #define R12A_TX_SCALE_SWING_M		0xffe00000
 #define R12A_TX_SCALE_SWING_S		21
@@ -930,8 +1044,14 @@
 #define R92C_RF_SYN_G(i)	(0x25 + (i))
 #define R92C_RF_RCK_OS		0x30
 #define R92C_RF_TXPA_G(i)	(0x31 + (i))
+#define R12A_RF_LUT_ADDR	0x30
+#define R12A_RF_LUT_DATA0	0x31
+#define R12A_RF_LUT_DATA1	0x32
 #define R88E_RF_T_METER		0x42
+#define R12A_RF_IQK_CTRL1	0x65
+#define R12A_RF_IQK_CTRL2	0x8f
 #define R12A_RF_LCK		0xb4
+#define R12A_RF_LUT_WE		0xef
 
 /* Bits for R92C_RF_AC. */
 #define R92C_RF_AC_MODE_M	0x70000
@@ -960,6 +1080,7 @@
  * CAM entries.
  */
 #define R12A_CAM_ENTRY_COUNT	64
+#define R92C_CAM_ENTRY_LEN	8	/* in dwords */
 
 #define R92C_CAM_CTL0(entry)	((entry) * 8 + 0)
 #define R92C_CAM_CTL1(entry)	((entry) * 8 + 1)
@@ -1280,7 +1401,10 @@ struct r92c_rx_stat {
 	uint32_t	rxdw1;
 #define R92C_RXDW1_MACID_M	0x0000003f
 #define R92C_RXDW1_MACID_S	0
+#define R12A_RXDW1_TID_M	0x00000f00
+#define R12A_RXDW1_TID_S	8
 #define R12A_RXDW1_AMSDU	0x00002000
+#define R12A_RXDW1_PAGGR	0x00008000
 #define R12A_RXDW1_CKSUM_ERR	0x00100000
 #define R12A_RXDW1_IPV6		0x00200000
 #define R12A_RXDW1_UDP		0x00400000
@@ -1306,6 +1430,13 @@ struct r92c_rx_stat {
 
 	uint32_t	rxdw4;
 #define R92C_RXDW4_SGI		0x00000001
+#define R12A_RXDW4_LDPC		0x00000002
+#define R12A_RXDW4_STBC		0x00000004
+#define R12A_RXDW4_BW_M		0x00000030
+#define R12A_RXDW4_BW_S		4
+#define R12A_RXDW4_BW20		0
+#define R12A_RXDW4_BW40		1
+#define R12A_RXDW4_BW80		2
 
 	uint32_t	rxdw5;
 } __packed __attribute__((aligned(4)));
@@ -1499,6 +1630,8 @@ static const uint8_t ridx2rate[] =
 #define URTWM_RIDX_OFDM48	10
 #define URTWM_RIDX_OFDM54	11
 #define URTWM_RIDX_MCS(i)	(12 + (i))
+/* Rx only. */
+#define URTWM_RIDX_VHT_MCS(ss, i)	(44 + 10 * (ss) + (i))
 
 #define URTWM_RIDX_COUNT	28
 #define URTWM_RIDX_UNKNOWN	(uint8_t)-1
@@ -2755,6 +2888,25 @@ static const struct urtwm_rf_prog rtl8821au_rf[] = {
 	{ 0, NULL, NULL, { 0 }, NULL }
 };
 
+/*
+ * RF settings for Tx / Rx IQK (RTL8812AU / RTL8821AU); taken from
+ * the vendor driver (_IQK_Tx_8812A() in halphyrf_8812a.c).
+ * R12A_RF_LUT_WE is written first (it enables the mode table
+ * access through R12A_RF_LUT_ADDR / R12A_RF_LUT_DATA*).
+ */
+static const uint8_t rtl8812au_iqk_rf_regs[] = {
+	R12A_RF_LUT_WE, R12A_RF_LUT_ADDR, R12A_RF_LUT_DATA0,
+	R12A_RF_LUT_DATA1, R12A_RF_IQK_CTRL1, R12A_RF_IQK_CTRL2
+};
+
+static const uint32_t rtl8812au_iqk_rf_tx[] = {
+	0x80002, 0x20000, 0x3fffd, 0xfe83f, 0x931d5, 0x8a001
+};
+
+static const uint32_t rtl8812au_iqk_rf_rx[] = {
+	0x80002, 0x30000, 0x3f7ff, 0xfe7bf, 0x931d0, 0x88001
+};
+
 
 struct urtwn_txpwr {
 	uint8_t	pwr[3][28];
@@ -18,12 +18,20 @@
  */
 
 #define URTWM_RX_LIST_COUNT		1
+#define URTWM_RX_LIST_MAX		8
 #define URTWM_TX_LIST_COUNT		16
+#define URTWM_TX_LIST_MAX		64
 
 #define URTWM_RXBUFSZ	(8 * 1024)
+#define URTWM_RXBUFSZ_MAX	(32 * 1024)
+/* Descriptor + max PHY status (INFOSZ) + max PKTLEN. */
+#define URTWM_RX_CARRY_MAX	(sizeof(struct r92c_rx_stat) + 15 * 8 + 0x3fff)
 #define URTWM_TXBUFSZ	(sizeof(struct r12a_tx_desc) + IEEE80211_MAX_LEN)
+#define URTWM_TXBUFSZ_MAX	(32 * 1024)
 
 #define URTWM_TX_TIMEOUT	5000	/* ms */
+#define URTWM_TX_TIMEOUT_MIN	100	/* ms */
+#define URTWM_TX_TIMEOUT_MAX	30000	/* ms */
 #define URTWM_CALIB_THRESHOLD	6
 
 #define URTWM_LED_LINK	0
@@ -64,30 +72,145 @@ struct urtwm_data {
 	uint16_t			buflen;
 	struct mbuf			*m;
 	struct ieee80211_node		*ni;
+	int				direct;	/* m holds Tx desc + frame */
+	uint8_t				ra_ridx; /* start rate (driver RA) */
+	uint8_t				ra_qsel;
 	STAILQ_ENTRY(urtwm_data)	next;
 };
 typedef STAILQ_HEAD(, urtwm_data) urtwm_datahead;
 
 struct urtwm_softc;
 
+/* IQ imbalance compensation (11-bit values, as reported by IQK). */
+struct urtwm_iqk_result {
+	uint16_t		tx_x[URTWM_MAX_RF_PATH];
+	uint16_t		tx_y[URTWM_MAX_RF_PATH];
+	uint16_t		rx_x[URTWM_MAX_RF_PATH];
+	uint16_t		rx_y[URTWM_MAX_RF_PATH];
+};
+
+/* Registers programmed on channel switch (see urtwm_set_chan()). */
+struct urtwm_chan_regs {
+	uint32_t		fc_area;
+	uint32_t		rfmod;
+	uint32_t		adc_buf_clk;
+	uint32_t		cca_on_sec;
+	uint32_t		l1_peak_th;
+	uint32_t		cck0_system;
+	uint32_t		chnlbw[2];	/* RF */
+	uint16_t		trxptcl_ctl;
+	uint8_t			data_sec;
+	uint8_t			reg837;		/* read-only */
+	uint8_t			band_5ghz;	/* R12A_CCK_CHECK */
+};
+
+/* Channel switch benchmark results (per channel). */
+struct urtwm_chansw_bench {
+	uint64_t		usec;
+	u_int			xfers;
+	int			chan;
+};
+
+/* Channel survey results (collected during scan). */
+struct urtwm_survey {
+	uint64_t		time;		/* usec */
+	uint64_t		cca_ofdm;
+	uint64_t		cca_cck;
+	uint64_t		fa_ofdm;
+	uint64_t		fa_cck;
+};
+
+struct urtwm_iqk_cache {
+	uint16_t		key;	/* see urtwm_iqk_key() */
+	uint8_t			valid;
+	int			used;	/* last access (ticks) */
+	struct urtwm_iqk_result	res;
+};
+#define URTWM_IQK_CACHE_SIZE	16
+#define URTWM_IQK_RETRY		3
+
+/* Bits for urtwm_iqk_cache.key. */
+#define URTWM_IQK_KEY_TEMP_M	0x003f
+#define URTWM_IQK_KEY_TEMP_S	0
+#define URTWM_IQK_KEY_GROUP_M	0x0f00
+#define URTWM_IQK_KEY_GROUP_S	8
+#define URTWM_IQK_KEY_HT40	0x1000
+#define URTWM_IQK_KEY_5GHZ	0x2000
+#define URTWM_IQK_KEY_VHT80	0x4000
+
 union sec_param {
 	struct ieee80211_key		key;
 	uint8_t				macid;
+	struct ieee80211_channel	*chan;
 };
 
 #define CMD_FUNC_PROTO			void (*func)(struct urtwm_softc *, \
 					    union sec_param *)
 
 struct urtwm_cmdq {
+	struct urtwm_cmdq		*next;	/* producers' stack */
+	STAILQ_ENTRY(urtwm_cmdq)	entry;	/* consumer's FIFO */
+	sbintime_t			enq_time;
+	int				cidx;	/* coalescing slot or -1 */
 	union sec_param			data;
 	CMD_FUNC_PROTO;
 };
-#define URTWM_CMDQ_SIZE			16
+#define URTWM_CMDQ_MAX_DEPTH		1024
+
+/* Driver rate control: per-rate statistics. */
+struct urtwm_ra_stats {
+	uint16_t		attempts;	/* current interval */
+	uint16_t		success;	/* current interval */
+	uint32_t		att_total;
+	uint16_t		prob;		/* EWMA, URTWM_RA_ONE = 100% */
+	uint32_t		tput;		/* expected, 100 Kbps units */
+};
+
+#define URTWM_RA_SCALE_SHIFT		10
+#define URTWM_RA_ONE			(1 << URTWM_RA_SCALE_SHIFT)
+#define URTWM_RA_EWMA_LEVEL		75	/* % of the old value */
+#define URTWM_RA_UPDATE_INTERVAL	(hz / 10)
+#define URTWM_RA_PROBE_INTERVAL		16	/* frames */
+#define URTWM_RA_TXQ_LEN		16
+#define URTWM_RA_TXQ_TIMEOUT		(hz / 2) /* Tx report was lost */
+#define URTWM_RA_QUEUE_TIME_MAX		4	/* do not probe above */
+
+/* Driver rate control: frame waiting for Tx report. */
+struct urtwm_ra_txq {
+	uint8_t			ridx;		/* start rate */
+	uint8_t			qsel;
+	int			time;		/* ticks */
+};
+
+/* Driver rate control: per-node state. */
+struct urtwm_ra_node {
+	uint32_t		rates;		/* usable rate indices */
+	uint8_t			lowest;
+	uint8_t			max_tp;		/* best throughput */
+	uint8_t			max_prob;	/* most robust */
+	uint8_t			probe_next;
+	uint16_t		nframes;	/* since the last probe */
+	uint32_t		nreports;
+	uint32_t		queue_time;	/* EWMA */
+	int			last_update;	/* ticks */
+
+	/* Frames handed to the device, oldest first. */
+	struct urtwm_ra_txq	txq[URTWM_RA_TXQ_LEN];
+	uint8_t			txq_len;
+
+	struct urtwm_ra_stats	stats[URTWM_RIDX_COUNT];
+};
 
 struct urtwm_node {
 	struct ieee80211_node	ni;	/* must be the first */
 	uint8_t			id;
 	int8_t			last_rssi;
+	struct urtwm_ra_node	ra;
+
+	int			key_active;	/* last Rx / Tx (ticks) */
+	int			key_retry;	/* last promotion attempt */
+	int			key_backoff;	/* promotion interval (ticks) */
+	uint8_t			key_sw;		/* key demoted to s/w */
 };
 #define URTWM_NODE(ni)	((struct urtwm_node *)(ni))
 
@@ -122,6 +245,17 @@ enum {
 
 #define	URTWM_EP_QUEUES	URTWM_BULK_RX
 
+/*
+ * Every Tx queue may have several transfers queued on its endpoint;
+ * additional ones follow the first set in the same queue order.
+ */
+#define URTWM_TX_NQUEUES	(URTWM_N_TRANSFER - URTWM_BULK_TX_BE)
+#define URTWM_TX_XFERS		2	/* per queue */
+#define URTWM_TX_XFERS_MAX	4
+#define URTWM_TX_XFER(_qid, _i)	((_qid) + (_i) * URTWM_TX_NQUEUES)
+#define URTWM_N_XFER(_n)	(URTWM_BULK_RX + 1 + (_n) * URTWM_TX_NQUEUES)
+#define URTWM_N_XFER_MAX	URTWM_N_XFER(URTWM_TX_XFERS_MAX)
+
 struct urtwm_softc {
 	struct ieee80211com	sc_ic;
 	struct mbufq		sc_snd;
@@ -140,6 +274,9 @@ struct urtwm_softc {
 #define URTWM_IQK_RUNNING	0x0040
 #define URTWM_RXCKSUM_EN	0x0080
 #define URTWM_RXCKSUM6_EN	0x0100
+#define URTWM_BGSCAN		0x0200
+#define URTWM_BGSCAN_OFFCHAN	0x0400
+#define URTWM_XFER_RECONF	0x0800
 
 	uint8_t			chip;
 #define URTWM_CHIP_12A		0x01
@@ -147,10 +284,20 @@ struct urtwm_softc {
 
 #define URTWM_CHIP_IS_12A(_sc)	!!((_sc)->chip & URTWM_CHIP_12A)
 #define URTWM_CHIP_IS_21A(_sc)	!((_sc)->chip & URTWM_CHIP_12A)
-
-#define URTWM_USE_RATECTL(_sc)	!!((_sc)->sc_flags & URTWM_FW_LOADED)
 #define URTWM_CHIP_HAS_BCNQ1(_sc)	URTWM_CHIP_IS_21A(_sc)
 
+	int			sc_ratectl;
+#define URTWM_RATECTL_NONE	0
+#define URTWM_RATECTL_NET80211	1
+#define URTWM_RATECTL_DRV	2
+#define URTWM_RATECTL_MAX	URTWM_RATECTL_DRV
+
+#define URTWM_USE_RATECTL(_sc)					\
+	((_sc)->sc_ratectl == URTWM_RATECTL_NET80211 &&		\
+	 ((_sc)->sc_flags & URTWM_FW_LOADED))
+#define URTWM_USE_DRV_RATECTL(_sc)				\
+	((_sc)->sc_ratectl == URTWM_RATECTL_DRV)
+
 	int			ext_pa_2g:1,
 				ext_pa_5g:1,
 				ext_lna_2g:1,
@@ -185,6 +332,42 @@ struct urtwm_softc {
 	uint8_t	bw80_tx_pwr_diff_5g[URTWM_MAX_RF_PATH][URTWM_MAX_TX_COUNT];
 	uint8_t	bw160_tx_pwr_diff_5g[URTWM_MAX_RF_PATH][URTWM_MAX_TX_COUNT];
 
+	/* Per-rate Tx power: [chain][group, 2GHz first][HT40]. */
+#define URTWM_TXPWR_CHAINS	2
+#define URTWM_TXPWR_GROUPS	(URTWM_MAX_GROUP_2G + URTWM_MAX_GROUP_5G)
+	uint8_t	txpwr_tbl[URTWM_TXPWR_CHAINS][URTWM_TXPWR_GROUPS][2]
+		    [URTWM_RIDX_COUNT];
+
+	/* Last written R12A_TXAGC_* values. */
+#define URTWM_TXAGC_COUNT	7	/* CCK11_1 ... MCS15_12 */
+	uint32_t		txagc[URTWM_TXPWR_CHAINS][URTWM_TXAGC_COUNT];
+	uint8_t			txagc_valid;	/* chain bitmap */
+
+	/* Channel switching. */
+	struct urtwm_chan_regs	chan_regs;	/* last written values */
+	int			chan_regs_valid;
+	u_int			chansw_count;
+	uint64_t		chansw_usec;	/* total */
+	uint64_t		chansw_usec_max;
+	uint64_t		chansw_xfers;	/* control transfers, total */
+	struct urtwm_chansw_bench *chansw_bench;	/* last run */
+	int			chansw_bench_n;
+	u_int			ctrl_xfers;
+
+	/* Background scanning. */
+	u_int			bgscan_dwell;	/* max dwell time, ms */
+	int			bgscan_left;	/* leaving BSS channel (ticks) */
+	u_int			bgscan_offchan;
+	u_int			bgscan_offchan_max; /* ms */
+	u_int			bgscan_drain_timeouts;
+#define URTWM_BGSCAN_DWELL	40	/* ms */
+#define URTWM_BGSCAN_DRAIN	20	/* ms, time budget */
+
+	/* Channel survey. */
+	struct urtwm_survey	*survey;	/* 2GHz, then 5GHz channels */
+	int			survey_idx;	/* -1 - not sampling */
+	sbintime_t		survey_start;
+
 	int			ntxchains;
         int			nrxchains;
 	int			ntx;
@@ -195,6 +378,98 @@ struct urtwm_softc {
 	int8_t			last_rssi;
 	uint8_t			thcal_temp;
 
+	/* Calibration scheduler. */
+	uint8_t			calib_pending;
+#define URTWM_CALIB_LCK		0x01
+#define URTWM_CALIB_IQK		0x02
+	int			calib_since;	/* first postponed (ticks) */
+	int			calib_last_temp; /* last temperature poll */
+	int			calib_window;	/* activity window start */
+	u_int			calib_tx_pkts;
+	u_int			calib_rx_pkts;
+	u_int			calib_idle_pps;	/* 'idle' threshold (pkts/s) */
+	u_int			calib_deadline;	/* max delay, seconds */
+	u_int			calib_deferred;
+	u_int			calib_forced;
+	u_int			calib_done;
+	uint64_t		calib_blocked_total;	/* usec */
+	uint64_t		calib_blocked_max;	/* usec */
+#define URTWM_CALIB_PERIOD	(2 * hz)
+#define URTWM_CALIB_RETRY	(hz / 5)
+#define URTWM_CALIB_IDLE_PPS	20
+#define URTWM_CALIB_DEADLINE	30
+
+	struct urtwm_iqk_cache	iqk_cache[URTWM_IQK_CACHE_SIZE];
+	u_int			iqk_hits;
+	u_int			iqk_misses;
+	struct ieee80211_channel *iqk_chan;	/* FW IQK in progress */
+
+	/* Thermal Tx power tracking. */
+	int			pwrtrk_enable;
+	int8_t			pwrtrk_delta;	/* 0.5 dB steps, > 0 - hot */
+	int8_t			pwrtrk_swing[URTWM_MAX_RF_PATH]; /* BB swing */
+	int8_t			pwrtrk_pwr[URTWM_MAX_RF_PATH]; /* Tx power index */
+	u_int			pwrtrk_updates;
+#define URTWM_PWRTRK_DELTA_MAX	29	/* thermal units */
+#define URTWM_PWRTRK_SWING_UP	2	/* max swing above efuse value */
+#define URTWM_PWRTRK_UP_MAX	6	/* max swing + Tx power raise */
+
+	/* Dynamic initial gain. */
+	int			dig_enable;
+	uint8_t			dig_igi;
+	uint8_t			dig_cck_pd;
+	uint8_t			dig_cck_pd_def;	/* after BB init */
+	u_int			dig_fa_ofdm;
+	u_int			dig_fa_cck;
+#define URTWM_DIG_INIT		0x20
+#define URTWM_DIG_MIN		0x1c
+#define URTWM_DIG_MAX		0x3e
+#define URTWM_DIG_MAX_OF_MIN	0x2a
+#define URTWM_DIG_RSSI_OFFSET	20
+#define URTWM_DIG_FA_TH0	0x200	/* per URTWM_CALIB_PERIOD */
+#define URTWM_DIG_FA_TH1	0x300
+#define URTWM_DIG_FA_TH2	0x400
+
+	/* EDCA turbo. */
+	int			edca_turbo_enable;
+	int			edca_turbo;	/* active */
+	int			edca_turbo_cnt;	/* qualifying periods */
+	u_int			edca_turbo_on;
+	int			edca_window;	/* byte counters start */
+	uint64_t		edca_tx_bytes[WME_NUM_AC];
+	uint64_t		edca_rx_bytes[WME_NUM_AC];
+	u_int			edca_rx_frames;
+	u_int			edca_tx_rpts;	/* Tx reports */
+	u_int			edca_tx_retries;
+	struct wmeParams	edca_turbo_be;
+#define URTWM_EDCA_TURBO_HOLD		2	/* periods before enabling */
+#define URTWM_EDCA_TURBO_MIN_RATE	(512 * 1024)	/* bytes/s */
+#define URTWM_EDCA_TURBO_RATIO		32	/* min BE / other ratio */
+#define URTWM_EDCA_TURBO_CCA_MAX	200	/* foreign CCA events / s */
+#define URTWM_EDCA_TURBO_RETRY_PCT	10	/* max retries per report */
+#define URTWM_EDCA_TURBO_AIFSN		2
+#define URTWM_EDCA_TURBO_LOGCWMIN	2
+#define URTWM_EDCA_TURBO_LOGCWMAX	4
+
+	/* Adaptive USB Rx aggregation. */
+#define URTWM_RXAGG_LOW		0	/* sparse / latency-sensitive */
+#define URTWM_RXAGG_MID		1	/* urtwm_config_specific() values */
+#define URTWM_RXAGG_HIGH	2	/* sustained bulk Rx */
+#define URTWM_RXAGG_NLEVELS	3
+	int			rxagg_enable;
+	int			rxagg_level;
+	int			rxagg_cnt;	/* qualifying periods */
+	u_int			rxagg_changes;
+	int			rxagg_window;	/* counters start */
+	uint64_t		rxagg_win_frames;
+	uint64_t		rxagg_win_bytes;
+	uint64_t		rxagg_xfers[URTWM_RXAGG_NLEVELS];
+	uint64_t		rxagg_frames[URTWM_RXAGG_NLEVELS];
+#define URTWM_RXAGG_HOLD	2	/* periods before raising */
+#define URTWM_RXAGG_LOW_PPS	100	/* frames/s */
+#define URTWM_RXAGG_HIGH_RATE	(2 * 1024 * 1024)	/* bytes/s */
+#define URTWM_RXAGG_HIGH_TIME	0x20	/* 32 us units */
+
 	int			nvaps;
 	int			ap_vaps;
 	int			bcn_vaps;
@@ -203,15 +478,53 @@ struct urtwm_softc {
 	int			vaps_running;
 	int			monvaps_running;
 
+	/* Rx filter for monitor mode (only monitor vaps are present). */
+	uint16_t		mon_fltmap[3];	/* RXFLTMAP0 - 2 */
+	uint8_t			mon_bssid[IEEE80211_ADDR_LEN];
+	int			mon_rxerr;	/* deliver CRC / ICV errors */
+	int			mon_profile;	/* -1 - custom */
+	int			mon_active;
+#define URTWM_MON_ONLY(_sc)	\
+	((_sc)->mon_vaps != 0 && (_sc)->nvaps == (_sc)->mon_vaps)
+
 	const char		*fwname;
 	uint16_t		fwver;
 	uint16_t		fwsig;
 	int			fwcur;
 
-	struct urtwm_data	sc_rx[URTWM_RX_LIST_COUNT];
+	struct urtwm_data	sc_rx[URTWM_RX_LIST_MAX];
 	urtwm_datahead		sc_rx_active;
 	urtwm_datahead		sc_rx_inactive;
-	struct urtwm_data	sc_tx[URTWM_TX_LIST_COUNT];
+	uint8_t			*rx_carry;	/* frame split between xfers */
+	int			rx_carry_len;
+	int			rx_carry_skip;	/* padding in the next xfer */
+	int			rx_agg_left;	/* frames left in the aggregate */
+	u_int			rx_carried;
+	u_int			rx_carry_drops;
+	int8_t			rssi_cck[2][256];	/* [HIPWR][cfosho[0]] */
+#define URTWM_RSSI_BENCH_PASSES	1024
+	uint64_t		rssi_bench_frames;	/* last run */
+	uint64_t		rssi_bench_ns_ref;
+	uint64_t		rssi_bench_ns_tbl;
+	u_int			rssi_bench_mismatch;
+
+	/* Optional Rx processing thread (see urtwm_rxq_task()). */
+	struct taskqueue	*sc_rxtq;
+	struct task		sc_rxtask;
+	struct mbufq		sc_rxq;
+	int			rxtq_enable;
+	int			rxtq_busy;	/* frames are queued / in flight */
+	struct thread		*rx_td;		/* passing frames to net80211 */
+	int			rx_keyblk;	/* key updates in progress */
+	int			rxtq_cpu;	/* -1 - not bound */
+	int			rxtq_limit;	/* max queued frames */
+	uint64_t		rxq_queued;
+	u_int			rxq_drops;
+	u_int			rxq_depth_max;
+#define URTWM_RXTQ_LIMIT	512
+#define URTWM_RXTQ_LIMIT_MIN	16
+#define URTWM_RXTQ_LIMIT_MAX	4096
+	struct urtwm_data	sc_tx[URTWM_TX_LIST_MAX];
 	urtwm_datahead		sc_tx_active;
 	int			sc_tx_n_active;
 	urtwm_datahead		sc_tx_inactive;
@@ -220,23 +533,68 @@ struct urtwm_softc {
 	uint16_t		next_rom_addr;
 	uint64_t		keys_bmap;
 
+	/* Key CAM contents (as written to hardware / to be written). */
+	uint32_t		cam_shadow[R12A_CAM_ENTRY_COUNT]
+					  [R92C_CAM_ENTRY_LEN];
+	uint32_t		cam_stage[R12A_CAM_ENTRY_COUNT]
+					 [R92C_CAM_ENTRY_LEN];
+	uint64_t		cam_staged;
+	uint64_t		cam_unknown;	/* contents not in cam_shadow */
+#define URTWM_CAM_BATCH		8	/* entries per write stream */
+/* Group keys: IEEE80211_WEP_NKID entries per port, starting from 0. */
+#define URTWM_CAM_GKEY_SLOTS	(2 * IEEE80211_WEP_NKID)
+#define URTWM_CAM_GKEY_ENTRY(id, kid)	((id) * IEEE80211_WEP_NKID + (kid))
+
+	/* Pairwise key owners' MACIDs (for LRU replacement). */
+	uint8_t			cam_macid[R12A_CAM_ENTRY_COUNT];
+	u_int			cam_demoted;
+	u_int			cam_promoted;
+	u_int			cam_full;
+#define URTWM_KEY_IDLE_MIN	(10 * hz)	/* min idle time to evict */
+#define URTWM_KEY_PROMOTE_INTERVAL	(hz)
+#define URTWM_KEY_BACKOFF_MAX	(60 * hz)	/* max promotion interval */
+
 	struct urtwm_vap	*vaps[2];
 	struct ieee80211_node	*node_list[R12A_MACID_MAX + 1];
+	uint64_t		rxnode_hits;	/* found via Rx MACID */
+	uint64_t		rxnode_misses;
 	struct mtx		nt_mtx;
 
 	struct callout		sc_calib_to;
+	struct callout		sc_bgscan_to;	/* dwell time limit */
 
 	struct mtx		sc_mtx;
 
 	struct callout		sc_pwrmode_init;
 
-	struct urtwm_cmdq	cmdq[URTWM_CMDQ_SIZE];
-        struct mtx		cmdq_mtx;
-        struct task		cmdq_task;
-        uint8_t			cmdq_first;
-        uint8_t			cmdq_last;
-
-	struct usb_xfer		*sc_xfer[URTWM_N_TRANSFER];
+	struct urtwm_cmdq	*cmdq_head;	/* lock-free LIFO */
+	STAILQ_HEAD(, urtwm_cmdq) cmdq_run;	/* taken by cmdq_task */
+	struct task		cmdq_task;
+	volatile u_int		cmdq_coalesce;	/* pending merged cmds */
+	volatile u_int		cmdq_depth;
+	u_int			cmdq_depth_max;
+	u_int			cmdq_enqueued;
+	u_int			cmdq_coalesced;
+	u_int			cmdq_dropped;
+	uint64_t		cmdq_executed;
+	uint64_t		cmdq_lat_total;	/* usec */
+	uint64_t		cmdq_lat_max;	/* usec */
+
+	struct usb_xfer		*sc_xfer[URTWM_N_XFER_MAX];
+	struct usb_config	sc_xfer_config[URTWM_N_XFER_MAX];
+
+	/* Transfer parameters (hints / sysctl, applied on next init). */
+	int			rx_bufsz;
+	int			tx_bufsz;
+	int			rx_list_count;
+	int			tx_list_count;
+	int			tx_timeout;	/* ms */
+	int			tx_xfers;	/* per Tx queue */
+
+	/* Tx from mbuf storage (descriptor in the leading space). */
+	int			tx_direct_enable;
+	uint64_t		tx_direct;
+	uint64_t		tx_copied;
 
 	struct wmeParams	cap_wmeParams[WME_NUM_AC];
 
@@ -254,7 +612,7 @@ struct urtwm_softc {
 	void		(*sc_parse_rom)(struct urtwm_softc *,
 			    struct r12a_rom *);
 	void		(*sc_set_led)(struct urtwm_softc *, int, int);
-	int8_t		(*sc_get_rssi_cck)(struct urtwm_softc *, void *);
+	int8_t		(*sc_cck_pwdb)(uint8_t, int);
 	int		(*sc_power_on)(struct urtwm_softc *);
 	void		(*sc_power_off)(struct urtwm_softc *);
 #ifndef URTWM_WITHOUT_UCODE
@@ -293,12 +651,6 @@ struct urtwm_softc {
 #define	URTWM_UNLOCK(sc)		mtx_unlock(&(sc)->sc_mtx)
 #define	URTWM_ASSERT_LOCKED(sc)		mtx_assert(&(sc)->sc_mtx, MA_OWNED)
 
-#define URTWM_CMDQ_LOCK_INIT(sc) \
-	mtx_init(&(sc)->cmdq_mtx, "cmdq lock", NULL, MTX_DEF)
-#define URTWM_CMDQ_LOCK(sc)		mtx_lock(&(sc)->cmdq_mtx)
-#define URTWM_CMDQ_UNLOCK(sc)		mtx_unlock(&(sc)->cmdq_mtx)
-#define URTWM_CMDQ_LOCK_DESTROY(sc)	mtx_destroy(&(sc)->cmdq_mtx)
-
 #define URTWM_NT_LOCK_INIT(sc) \
 	mtx_init(&(sc)->nt_mtx, "node table lock", NULL, MTX_DEF)
 #define URTWM_NT_LOCK(sc)		mtx_lock(&(sc)->nt_mtx)